@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Content kinds, computed once at capture and stored as a bitmask
+   (items.kind) plus one row per set bit in the item_kinds index. */
+enum {
+    CHUB_KIND_URL       = 1 << 0,
+    CHUB_KIND_PATH      = 1 << 1,
+    CHUB_KIND_JSON      = 1 << 2,
+    CHUB_KIND_CODE      = 1 << 3,
+    CHUB_KIND_EMAIL     = 1 << 4,
+    CHUB_KIND_NUMBER    = 1 << 5,
+    CHUB_KIND_MULTILINE = 1 << 6,
+    /* exactly one size bucket is set */
+    CHUB_KIND_SMALL     = 1 << 7,   /* < 80 bytes */
+    CHUB_KIND_MEDIUM    = 1 << 8,   /* < 1 KiB */
+    CHUB_KIND_LARGE     = 1 << 9,   /* < 16 KiB */
+    CHUB_KIND_HUGE      = 1 << 10
+};
+
+#define CHUB_KIND_BITS 11
+#define CHUB_KIND_SIZES (CHUB_KIND_SMALL | CHUB_KIND_MEDIUM | CHUB_KIND_LARGE | CHUB_KIND_HUGE)
+
+unsigned chub_classify(const char *s, size_t len);
+
+/* "url" -> CHUB_KIND_URL; 0 if unknown */
+unsigned    chub_kind_from_name(const char *name, size_t len);
+const char *chub_kind_name(unsigned bit);  /* one bit; NULL if unknown */
+
+/* Facet filter: each clause is an OR of kinds, clauses are ANDed.
+   "type:url,json size:large foo" -> {URL|JSON, LARGE}, rest "foo". */
+#define CHUB_FACET_MAX 8
+
+typedef struct {
+    unsigned any[CHUB_FACET_MAX];
+    int n;
+} chub_facets;
+
+/* Leading type:/size: tokens are consumed; *rest points at the remaining
+   term. Returns 0, 1 for an unknown name or one of the other prefix's
+   (type:huge, size:url; echoed in err), or 2 for more than CHUB_FACET_MAX
+   clauses. */
+int chub_facets_parse(const char *query, chub_facets *out, const char **rest,
+                      char *err, size_t err_sz);
+int chub_facets_match(const chub_facets *f, unsigned kind);
+
+#ifdef __cplusplus
+}
+#endif
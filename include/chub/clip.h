@@ -10,6 +10,20 @@ int chub_clip_read(char *buf, size_t buf_sz);
 /* returns 0 on success */
 int chub_clip_write(const char *data);
 
+/* Background writer so copy-back never blocks the UI. Writes queued while
+   one is in flight are coalesced: only the newest payload is written. */
+int  chub_clip_writer_start(void);  /* returns 0 on success */
+void chub_clip_writer_stop(void);   /* drains the pending write, then joins */
+/* queue a copy; returns its sequence number (> 0) or -1 */
+int  chub_clip_write_async(const char *data);
+/* 1 if a write finished since the last call; *out_rc as chub_clip_write.
+   *out_seq is the newest finished sequence (older coalesced ones are implied) */
+int  chub_clip_writer_poll(int *out_seq, int *out_rc);
+
+/* 1 if h is the hash of a recent self-originated write (tag is consumed),
+   so the capture path can bump the existing entry instead of inserting */
+int  chub_clip_is_self_write(unsigned long long h);
+
 /* optional */
 int chub_clip_smoketest(void);
 
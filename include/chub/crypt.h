@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Entry-level encryption at rest: AES-256-GCM through Windows CNG (which
+   uses AES-NI/PCLMULQDQ when the CPU has them). Sealed form:
+     'E', 12-byte random nonce, ciphertext, 16-byte tag
+   The row id is authenticated as associated data, so a ciphertext moved
+   to another row fails to open. */
+
+#define CHUB_CRYPT_KEY_BYTES  32
+#define CHUB_CRYPT_SALT_BYTES 16
+#define CHUB_CRYPT_OVERHEAD   29      /* bytes a sealed value adds */
+#define CHUB_CRYPT_KDF_ITERS  600000  /* PBKDF2-HMAC-SHA256 */
+
+int chub_crypt_random(unsigned char *buf, size_t n);
+/* passphrase -> key; 0 on success */
+int chub_crypt_derive(const char *passphrase, const unsigned char *salt, size_t salt_len,
+                      unsigned iters, unsigned char key[CHUB_CRYPT_KEY_BYTES]);
+/* key = SHA-256 of the file; it must hold at least 32 bytes. 4 if shorter */
+int chub_crypt_read_keyfile(const char *path, unsigned char key[CHUB_CRYPT_KEY_BYTES]);
+
+/* install the master key (data and tag subkeys are derived from it) */
+int  chub_crypt_set_key(const unsigned char key[CHUB_CRYPT_KEY_BYTES]);
+void chub_crypt_clear(void);
+int  chub_crypt_enabled(void);
+
+/* *out is malloc'd. open() NUL-terminates and returns 2 if the value is
+   malformed, was sealed under another key, or belongs to another id */
+int chub_crypt_seal(long long id, const void *plain, size_t len,
+                    unsigned char **out, size_t *out_len);
+int chub_crypt_open(long long id, const void *sealed, size_t len,
+                    char **out, size_t *out_len);
+
+/* keyed 64-bit tag of a content hash, so stored hashes can't confirm guesses */
+unsigned long long chub_crypt_tag64(unsigned long long h);
+/* keyed XOR pad for SimHash sketches; preserves Hamming distances */
+unsigned long long chub_crypt_pad64(void);
+
+#ifdef __cplusplus
+}
+#endif
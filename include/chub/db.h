@@ -1,29 +1,154 @@
 #pragma once
 #include <stddef.h>
+#include "chub/resultset.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct sqlite3;
+
+/* result orders; chub/scan.h uses the same values */
+enum { CHUB_ORDER_TS = 0, CHUB_ORDER_SCORE = 1, CHUB_ORDER_FRECENCY = 2 };
+
+#define CHUB_DB_PREVIEW_MAX 512   /* bytes of text kept next to the hot columns */
+
+#define CHUB_FRECENCY_HALF_LIFE_MS (7LL * 24 * 60 * 60 * 1000)
+#define CHUB_FRECENCY_USE_WEIGHT   4.0   /* a copy-back counts as four captures */
+/* sort key for frecency order: favorites above everything else */
+#define CHUB_DB_RANK_SQL "(favorite * 1e9 + frecency)"
+/* full text of item_text alias t; near-duplicates are stored as deltas */
+#define CHUB_DB_TEXT_SQL "chub_text(t.id,t.text,t.base,t.delta)"
+
+/* storage pragmas, applied to every connection; call before chub_db_open */
+typedef struct {
+    long long mmap_size;  /* bytes; 0 disables memory-mapped I/O */
+    int cache_kib;        /* page cache per connection */
+    int temp_store;       /* PRAGMA temp_store: 0 default, 1 file, 2 memory */
+} chub_db_config;
+
+#define CHUB_DB_CONFIG_DEFAULT { 64LL * 1024 * 1024, 8 * 1024, 2 }
+
+void chub_db_configure(const chub_db_config *cfg);
+void chub_db_apply_pragmas(struct sqlite3 *db);
+/* SQL functions other connections need to read text (chub_text) */
+void chub_db_register_functions(struct sqlite3 *db);
+
+/* encryption at rest (chub/crypt.h); call before chub_db_open. The first
+   open with a key encrypts the database in place; from then on it won't
+   open without one. */
 typedef struct {
-    int id;
-    long long ts;
-    int favorite;
-    char *text;            /* heap-allocated UTF-8 text */
-    unsigned long long h;  /* hash of text */
-} chub_item;
+    const char *passphrase;  /* PBKDF2 with a per-database salt */
+    const char *key_file;    /* or: SHA-256 of this file (takes precedence) */
+    int plain_previews;      /* opt-out: previews stay plaintext, so the list
+                                paints without decrypting and the snapshot is kept */
+} chub_db_crypt_config;
 
+void chub_db_configure_crypt(const chub_db_crypt_config *cfg);
+
+/* opens and migrates the schema to the current user_version; 3 if the
+   database is encrypted and the key is missing or wrong */
 int chub_db_open(const char *path);
 void chub_db_close(void);
+/* 1 once chub_db_open has finished (it may run on a background thread) */
+int chub_db_ready(void);
 
-int chub_db_insert(const char *text, unsigned long long h, long long ts);
+/* kind: chub_classify() bits */
+int chub_db_insert(const char *text, unsigned long long h, long long ts, unsigned kind);
+/* move the newest entry with hash h to ts; returns 4 if there is none */
+int chub_db_touch(unsigned long long h, long long ts);
+/* a copy-back: bumps uses/last_used and folds the use into frecency */
+int chub_db_record_use(int id, long long ts);
 int chub_db_mark_favorite(int id, int fav);
 int chub_db_delete(int id);
 int chub_db_prune(int keep_limit);
-int chub_db_fetch_recent(int limit, chub_item **out_arr, int *out_count);
-int chub_db_search(const char *needle, int limit, chub_item **out_arr, int *out_count);
+/* periodic upkeep: an incremental_vacuum step when pages are free, PRAGMA optimize */
+int chub_db_maintain(void);
+
+/* full text of one entry (malloc'd); 4 if it no longer exists */
+int chub_db_fetch_text(int id, char **out, size_t *out_len);
+
+/* storage report: near-duplicate deltas and what reading them costs */
+typedef struct {
+    long long entries;
+    long long logical_bytes;  /* full text of every entry */
+    long long stored_bytes;   /* text + delta bytes actually kept */
+    long long deltas;         /* entries stored as a delta */
+    double avg_depth;         /* over deltas */
+    int max_depth;
+    int sampled;              /* deltas rebuilt for the latency figures */
+    double rebuild_avg_us, rebuild_max_us;
+} chub_db_stats;
+
+/* sample: how many of the newest deltas to reconstruct and time */
+int chub_db_get_stats(int sample, chub_db_stats *out);
+
+/* arena-backed variants (preferred on hot paths); *out is NULL on error,
+   otherwise a possibly empty set to release with chub_rs_free(). Rows hold
+   a preview of at most CHUB_DB_PREVIEW_MAX bytes (chub_rs_is_preview). */
+int chub_db_fetch_recent_rs(int limit, chub_resultset **out);
+/* favorites first, then by frecency (time-decayed use count) */
+int chub_db_fetch_ranked_rs(int limit, chub_resultset **out);
+int chub_db_search_rs(const char *needle, int limit, chub_resultset **out);
+
+/* regex search (see chub/regex.h); budget_ms <= 0 means no time limit.
+   returns 5 if over budget (*out holds the rows found so far),
+   6 if the pattern doesn't compile (message in err) */
+int chub_db_search_regex(const char *pattern, int limit, int budget_ms,
+                         chub_resultset **out, char *err, size_t err_sz);
+/* facet search (chub/classify.h): walks the item_kinds index so only rows
+   whose kind satisfies every clause (an OR of bits each) are read; match
+   may be NULL to keep them all. order: CHUB_ORDER_*. */
+typedef double (*chub_db_match_fn)(const char *text, size_t len, void *ctx);
+int chub_db_search_kinds(const unsigned *clauses, int nclauses,
+                         chub_db_match_fn match, void *ctx, int order,
+                         int limit, int budget_ms, chub_resultset **out);
+
+/* for the parallel scan executor (chub/scan.h) */
+const char *chub_db_path(void);  /* NULL until ready */
+int chub_db_id_range(long long *out_min, long long *out_max);  /* max < min when empty */
+/* rows for ids in the given order; ids that no longer exist are skipped */
+int chub_db_fetch_ids(const int *ids, int n, chub_resultset **out);
+
+/* ----- change log for sync between instances (chub/sync.h) -----
+   Once enabled, every insert, favorite, delete and prune is logged in its
+   own transaction with a per-instance sequence number and a hybrid logical
+   clock. Instances know entries by content hash (chub_hash64 of the text). */
+enum { CHUB_CHANGE_INSERT = 1, CHUB_CHANGE_FAVORITE = 2, CHUB_CHANGE_DELETE = 3, CHUB_CHANGE_PRUNE = 4 };
+
+#define CHUB_HLC_LOGICAL_BITS 16  /* hlc = wall ms << 16 | counter */
+#define CHUB_SYNC_NODE_LEN    16  /* hex digits of an instance id */
+
+typedef struct {
+    long long seq;          /* per instance, increasing */
+    long long hlc;
+    int op;                 /* CHUB_CHANGE_* */
+    int arg;                /* favorite: the new flag */
+    unsigned long long h;   /* content hash */
+    long long ts;           /* capture time */
+    unsigned kind;          /* chub_classify() bits */
+    char *text;             /* inserts only, malloc'd; NULL if the entry is gone */
+    size_t len;
+} chub_change;
 
-void chub_db_free_items(chub_item *arr, int count);
+/* starts logging; the first call picks the instance id and logs the
+   current history as inserts. *exported: last seq already in a segment.
+   7 if the database is encrypted (segments would carry plaintext) */
+int chub_db_sync_enable(char node[CHUB_SYNC_NODE_LEN + 1], long long *exported);
+/* up to limit local changes after seq, oldest first */
+int chub_db_changes_since(long long seq, int limit, chub_change **out, int *out_count);
+void chub_db_free_changes(chub_change *arr, int count);
+/* changes up to seq are in a segment: drop them from the database */
+int chub_db_changes_exported(long long seq);
+/* last seq of node merged here; 0 if none */
+long long chub_db_peer_seq(const char *node);
+/* merges a peer's changes in one transaction, last writer (by clock) wins
+   per content hash. Changes at or below the peer's merged seq are skipped,
+   so replaying a segment is harmless. through: the last seq the changes
+   cover (a segment's range may have gaps); it becomes the merged seq.
+   *applied: changes that altered rows */
+int chub_db_apply_changes(const char *node, const chub_change *arr, int count,
+                          long long through, int *applied);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Near-duplicate storage helpers: a 64-bit SimHash sketch over byte
+   shingles, a small LSH index over the sketches of recent entries, and a
+   COPY/ADD delta codec against a base text. */
+
+unsigned long long chub_simhash(const char *s, size_t len);
+int chub_simhash_distance(unsigned long long a, unsigned long long b);
+
+/* LSH over the last CHUB_LSH_ENTRIES sketches (4 bands of 16 bits, so any
+   pair within 3 bits shares a band). Not thread-safe; the db serializes. */
+#define CHUB_LSH_ENTRIES 256
+
+void chub_lsh_reset(void);
+void chub_lsh_add(int id, unsigned long long sketch, int depth);
+/* ids within max_dist bits, closest first; returns how many were written */
+int  chub_lsh_query(unsigned long long sketch, int max_dist, int max_depth,
+                    int *ids, int max_ids);
+
+/* delta of target against base; *out is malloc'd. 0 on success */
+int chub_delta_encode(const char *base, size_t base_len,
+                      const char *target, size_t target_len,
+                      unsigned char **out, size_t *out_len);
+/* rebuild the target; *out is malloc'd and NUL-terminated. 0 on success,
+   2 if the delta is malformed or doesn't fit the base */
+int chub_delta_apply(const char *base, size_t base_len,
+                     const unsigned char *delta, size_t delta_len,
+                     char **out, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Small byte-oriented regex engine (Pike VM, linear in input length).
+   Supports . [] [^] \d \w \s (and negations) ^ $ (line anchors) ( ) (?:)
+   | * + ? {m} {m,} {m,n}, \n \t \r, a backslash before any punctuation,
+   and a leading (?i) for case-insensitive. Other escapes are rejected.
+   Literals that every match must contain are extracted at compile time so
+   callers can reject most rows with a memchr-driven scan first. */
+typedef struct chub_regex chub_regex;
+
+/* returns 0 on success; on failure writes a message into err */
+int  chub_regex_compile(const char *pattern, chub_regex **out, char *err, size_t err_sz);
+void chub_regex_free(chub_regex *re);
+
+/* 0 if s cannot match (required literal absent), 1 if it might */
+int  chub_regex_prefilter(const chub_regex *re, const char *s, size_t len);
+/* 1 on match, 0 otherwise; runs the prefilter first. Thread-safe. */
+int  chub_regex_match(const chub_regex *re, const char *s, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Query result backed by one arena: hot fields are stored column-wise and
+   texts are packed back to back, so freeing is O(1) regardless of rows.
+   The struct is opaque; use the accessors so the layout can change. */
+typedef struct chub_resultset chub_resultset;
+
+chub_resultset *chub_rs_new(void);
+void chub_rs_free(chub_resultset *rs);
+
+/* append a row (text copied into the arena); returns 0 on success */
+int chub_rs_push(chub_resultset *rs, int id, long long ts, int favorite,
+                 unsigned long long h, const char *text, size_t len);
+/* same, for a row carrying only a preview of an entry full_len bytes long */
+int chub_rs_push_preview(chub_resultset *rs, int id, long long ts, int favorite,
+                         unsigned long long h, const char *text, size_t len, size_t full_len);
+
+int                chub_rs_count(const chub_resultset *rs);
+int                chub_rs_id(const chub_resultset *rs, int i);
+long long          chub_rs_ts(const chub_resultset *rs, int i);
+int                chub_rs_favorite(const chub_resultset *rs, int i);
+unsigned long long chub_rs_hash(const chub_resultset *rs, int i);
+size_t             chub_rs_length(const chub_resultset *rs, int i);       /* of chub_rs_text */
+size_t             chub_rs_full_length(const chub_resultset *rs, int i);
+int                chub_rs_is_preview(const chub_resultset *rs, int i);   /* text is truncated */
+const char        *chub_rs_text(const chub_resultset *rs, int i); /* NUL-terminated */
+int                chub_rs_find_id(const chub_resultset *rs, int id); /* index or -1 */
+
+void chub_rs_set_favorite(chub_resultset *rs, int i, int favorite);
+
+#ifdef __cplusplus
+}
+#endif
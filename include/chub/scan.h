@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+#include "chub/classify.h"
+#include "chub/resultset.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parallel history scan. The id space is cut into shards that a pool of
+   worker threads (one read-only SQLite connection each) process with work
+   stealing; every worker keeps its own top-K and the results are merged.
+   Matchers must be thread-safe: they are called concurrently.
+   Each worker reads its own snapshot. Rows captured after the run starts
+   are outside its id range, but an entry deleted mid-run may still be
+   matched by a worker that started earlier; it then drops out when the
+   result rows are fetched. */
+
+/* same values as CHUB_ORDER_* in chub/db.h */
+enum { CHUB_SCAN_BY_TS = 0, CHUB_SCAN_BY_SCORE = 1, CHUB_SCAN_BY_FRECENCY = 2 };
+
+/* return a score > 0 to keep the row, 0 to skip it */
+typedef double (*chub_scan_match_fn)(const char *text, size_t len, void *ctx);
+
+typedef struct {
+    chub_scan_match_fn match;
+    void *ctx;
+    int order;       /* CHUB_SCAN_BY_* (ties by ts) */
+    int limit;       /* top-K kept */
+    int budget_ms;   /* <= 0: no limit */
+    const chub_facets *facets;  /* optional; served from the kind index, match may be NULL */
+} chub_scan_query;
+
+/* threads <= 0: one per core. Requires chub_db_open() to have succeeded. */
+int  chub_scan_start(int threads);
+void chub_scan_stop(void);
+
+/* 0 on success; 5 if over budget (*out holds the best rows
+   found so far); *out is NULL on other errors */
+int chub_scan_run(const chub_scan_query *q, chub_resultset **out);
+
+/* built-in matchers */
+double chub_scan_match_substring(const char *text, size_t len, void *needle);  /* ASCII case-insensitive; % and _ are literal */
+double chub_scan_match_regex(const char *text, size_t len, void *re);          /* ctx: chub_regex* */
+double chub_scan_match_fuzzy(const char *text, size_t len, void *pattern);     /* in-order subsequence; scored */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Capture-path secret filter. Literal prefixes (AKIA, ghp_, -----BEGIN ...)
+   are compiled into one Aho-Corasick automaton that runs in the same loop
+   as the FNV-1a hash; token entropy/length heuristics are evaluated only
+   on candidate tokens. */
+
+enum { CHUB_SECRET_OFF = 0, CHUB_SECRET_DROP = 1, CHUB_SECRET_REDACT = 2 };
+
+#define CHUB_SECRET_MAX_RULES 64
+
+typedef struct {
+    unsigned long long h;          /* chub_hash64 of the scanned text */
+    int hits;                      /* matched spans to redact */
+    int drop;                      /* action is DROP and something matched */
+    unsigned long long rule_mask;  /* bit i = rule i fired, counting-only rules too */
+} chub_secret_result;
+
+/* Rules file, one per line ('#' comments):
+     prefix  NAME LITERAL [MIN_TOKEN_LEN] [block]
+     entropy NAME MIN_LEN MIN_BITS_PER_CHAR
+     password NAME MIN_LEN MAX_LEN [redact]
+   password rules only count matches unless marked redact: the heuristic
+   also fires on ordinary identifiers and file names. path NULL loads the built-in rules. Returns 0 on success. */
+int  chub_secret_init(const char *rules_path);
+void chub_secret_free(void);
+void chub_secret_set_action(int action);
+int  chub_secret_action(void);
+
+/* one pass over s: hash + match; never modifies s */
+void chub_secret_scan(const char *s, size_t len, chub_secret_result *res);
+/* rewrite every matched span as "[redacted]". 4 if memory ran out: s is
+   then unchanged and must not be stored */
+int chub_secret_redact(char *s, size_t buf_sz);
+/* add a scan's hits to the per-rule counters */
+void chub_secret_record(const chub_secret_result *res);
+
+int         chub_secret_rule_count(void);
+const char *chub_secret_rule_name(int i);
+long        chub_secret_rule_hits(int i);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include "chub/resultset.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compact on-disk copy of the hot history (record table + NUL-terminated
+   previews) that the TUI can paint from before SQLite is open. */
+
+#define CHUB_SNAPSHOT_ITEMS       500   /* matches the TUI list cap */
+#define CHUB_SNAPSHOT_PREVIEW_MAX 2048  /* bytes of text kept per entry */
+
+/* map an existing snapshot read-only; returns 0 on success */
+int  chub_snapshot_open(const char *path);
+void chub_snapshot_close(void);
+
+/* copy the mapped rows into a new result set (previews only) */
+int  chub_snapshot_load(chub_resultset **out);
+
+/* write rows atomically (tmp file + rename); returns 0 on success */
+int  chub_snapshot_write(const char *path, const chub_resultset *rs);
+
+#ifdef __cplusplus
+}
+#endif
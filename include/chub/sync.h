@@ -0,0 +1,36 @@
+#pragma once
+#include "chub/db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sync between instances through a shared folder (a synced drive, a
+   network share). Each instance writes its change log (chub/db.h) under
+   DIR/<instance id>/ as immutable segment files named by the first and
+   last sequence number they hold, and merges the segments of the other
+   instances it hasn't seen yet. A run only reads and writes new segments,
+   so its cost follows what changed rather than the size of the history. */
+
+#define CHUB_SYNC_SEGMENT_CHANGES  1024  /* changes per exported segment */
+#define CHUB_SYNC_COMPACT_SEGMENTS 32    /* own segments that trigger a compaction */
+
+typedef struct {
+    char node[CHUB_SYNC_NODE_LEN + 1];  /* this instance */
+    int exported;           /* changes written */
+    int segments_written;
+    int peers;              /* other instances found */
+    int segments_read;
+    int changes_read;
+    int applied;            /* merged changes that altered the history */
+    int compacted;          /* own segments folded into one; 0 if none */
+    int dropped;            /* superseded changes removed by compaction */
+} chub_sync_report;
+
+/* export, merge, then compact our own segments if there are many. The
+   database must be open. 7 if it is encrypted, 3 on I/O errors */
+int chub_sync_run(const char *dir, chub_sync_report *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,6 +5,7 @@ extern "C" {
 #endif
 
 int chub_tui_mainloop(void); /* returns 0 on normal quit */
+void chub_tui_request_quit(void); /* safe from any thread */
 
 #ifdef __cplusplus
 }
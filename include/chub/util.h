@@ -7,7 +7,11 @@ extern "C" {
 
 void chub_log(const char *level, const char *fmt, ...);
 unsigned long long chub_hash64(const char *s);
+/* largest prefix <= max bytes that doesn't split a UTF-8 sequence */
+size_t chub_utf8_clip(const char *s, size_t len, size_t max);
 long long chub_now_millis(void);
+/* monotonic, for timing intervals */
+long long chub_now_micros(void);
 int chub_mkdir_p(const char *path);
 int chub_path_join(const char *a, const char *b, char *out, size_t out_sz);
 
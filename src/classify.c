@@ -0,0 +1,218 @@
+#include "chub/classify.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static const struct { const char *name; unsigned bit; } KINDS[] = {
+    { "url",       CHUB_KIND_URL },
+    { "path",      CHUB_KIND_PATH },
+    { "json",      CHUB_KIND_JSON },
+    { "code",      CHUB_KIND_CODE },
+    { "email",     CHUB_KIND_EMAIL },
+    { "number",    CHUB_KIND_NUMBER },
+    { "multiline", CHUB_KIND_MULTILINE },
+    { "small",     CHUB_KIND_SMALL },
+    { "medium",    CHUB_KIND_MEDIUM },
+    { "large",     CHUB_KIND_LARGE },
+    { "huge",      CHUB_KIND_HUGE },
+};
+
+#define NKINDS (sizeof(KINDS) / sizeof(KINDS[0]))
+
+static const char *CODE_STARTS[] = {
+    "#include", "#define", "import ", "from ", "def ", "class ", "function ",
+    "const ", "let ", "var ", "return ", "if (", "for (", "while (",
+    "SELECT ", "select ", "INSERT ", "UPDATE ", "CREATE ", "package ", "using ",
+};
+
+static int has_prefix(const char *s, size_t n, const char *p) {
+    size_t k = strlen(p);
+    return n >= k && memcmp(s, p, k) == 0;
+}
+
+static int is_url(const char *s, size_t n) {
+    static const char *schemes[] = { "http://", "https://", "ftp://", "file://", "mailto:", "www." };
+    for (size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); ++i)
+        if (has_prefix(s, n, schemes[i]) && n > strlen(schemes[i])) return 1;
+    return 0;
+}
+
+static int is_email(const char *s, size_t n) {
+    const char *at = memchr(s, '@', n);
+    if (!at || at == s) return 0;
+    const char *dom = at + 1;
+    size_t dn = n - (size_t)(dom - s);
+    if (memchr(dom, '@', dn)) return 0;
+    const char *dot = memchr(dom, '.', dn);
+    if (!dot || dot == dom || dot == s + n - 1) return 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (!isalnum(c) && !strchr("@._%+-", c)) return 0;
+    }
+    return 1;
+}
+
+static int is_number(const char *s, size_t n) {
+    size_t i = 0;
+    if (s[i] == '+' || s[i] == '-') ++i;
+    if (n - i > 2 && s[i] == '0' && (s[i+1] == 'x' || s[i+1] == 'X')) {
+        for (i += 2; i < n; ++i) if (!isxdigit((unsigned char)s[i])) return 0;
+        return 1;
+    }
+    int digits = 0, exp = 0;
+    for (; i < n; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (isdigit(c)) { digits++; continue; }
+        if (c == '.' || c == ',' || c == '_') continue;
+        if ((c == 'e' || c == 'E') && digits && !exp) {
+            exp = 1;
+            if (i + 1 < n && (s[i+1] == '+' || s[i+1] == '-')) ++i;
+            continue;
+        }
+        if (c == '%' && i == n - 1) continue;
+        return 0;
+    }
+    return digits > 0;
+}
+
+static int is_path(const char *s, size_t n, int tokens) {
+    if (has_prefix(s, n, "/") || has_prefix(s, n, "~/") || has_prefix(s, n, "./") ||
+        has_prefix(s, n, "../") || has_prefix(s, n, "\\\\"))
+        return n > 1;
+    if (n >= 3 && isalpha((unsigned char)s[0]) && s[1] == ':' && (s[2] == '\\' || s[2] == '/'))
+        return 1;
+    /* relative: a single token with a separator and no URL/mail markers */
+    if (tokens == 1 && (memchr(s, '/', n) || memchr(s, '\\', n)) &&
+        !memchr(s, '@', n) && !memchr(s, ':', n)) {
+        for (size_t i = 0; i < n; ++i) if (isalpha((unsigned char)s[i])) return 1;
+    }
+    return 0;
+}
+
+/* bracket balance outside strings; cheap structural check, not a parser */
+static int is_json(const char *s, size_t n) {
+    char open = s[0], close = s[n - 1];
+    if (!((open == '{' && close == '}') || (open == '[' && close == ']'))) return 0;
+    int depth = 0, in_str = 0, colons = 0;
+    for (size_t i = 0; i < n; ++i) {
+        char c = s[i];
+        if (in_str) {
+            if (c == '\\') ++i;
+            else if (c == '"') in_str = 0;
+            continue;
+        }
+        switch (c) {
+        case '"': in_str = 1; break;
+        case '{': case '[': depth++; break;
+        case '}': case ']': if (--depth < 0) return 0; break;
+        case ':': colons++; break;
+        case ';': return 0;
+        default: break;
+        }
+        if (depth == 0 && i != n - 1) return 0;
+    }
+    return depth == 0 && !in_str && (open == '[' || colons > 0 || n == 2);
+}
+
+static int looks_like_code(const char *s, size_t n, int lines, int code_eol, int ops) {
+    for (size_t i = 0; i < sizeof(CODE_STARTS) / sizeof(CODE_STARTS[0]); ++i)
+        if (has_prefix(s, n, CODE_STARTS[i])) return 1;
+    if (lines >= 2) return code_eol * 3 >= lines;
+    char last = s[n - 1];
+    return (last == ';' || last == '{') && ops > 0;
+}
+
+unsigned chub_classify(const char *s, size_t len) {
+    unsigned kind = len < 80 ? CHUB_KIND_SMALL
+                  : len < 1024 ? CHUB_KIND_MEDIUM
+                  : len < 16 * 1024 ? CHUB_KIND_LARGE
+                  : CHUB_KIND_HUGE;
+    if (!s) return kind;
+    size_t a = 0, b = len;
+    while (a < b && isspace((unsigned char)s[a])) ++a;
+    while (b > a && isspace((unsigned char)s[b - 1])) --b;
+    if (a == b) return kind;
+    const char *t = s + a;
+    size_t n = b - a;
+
+    /* one pass for the shape; the specific checks below run only when it fits */
+    int lines = 1, tokens = 1, code_eol = 0, ops = 0;
+    char prev_ns = 0;  /* last non-space byte */
+    for (size_t i = 0; i < n; ++i) {
+        char c = t[i];
+        if (c == '\n') {
+            lines++;
+            if (prev_ns == ';' || prev_ns == '{' || prev_ns == '}' || prev_ns == ')' || prev_ns == ':')
+                code_eol++;
+        }
+        if (isspace((unsigned char)c)) {
+            if (i + 1 < n && !isspace((unsigned char)t[i + 1])) tokens++;
+            continue;
+        }
+        if (c == '(' || c == '=' || c == '{') ops++;
+        prev_ns = c;
+    }
+    if (prev_ns == ';' || prev_ns == '{' || prev_ns == '}' || prev_ns == ')') code_eol++;
+
+    if (lines > 1) kind |= CHUB_KIND_MULTILINE;
+    if (tokens == 1) {
+        if (is_url(t, n)) return kind | CHUB_KIND_URL;
+        if (is_email(t, n)) return kind | CHUB_KIND_EMAIL;
+        if (is_number(t, n)) return kind | CHUB_KIND_NUMBER;
+    }
+    if (lines == 1 && is_path(t, n, tokens)) return kind | CHUB_KIND_PATH;
+    if (is_json(t, n)) return kind | CHUB_KIND_JSON;
+    if (looks_like_code(t, n, lines, code_eol, ops)) kind |= CHUB_KIND_CODE;
+    return kind;
+}
+
+unsigned chub_kind_from_name(const char *name, size_t len) {
+    for (size_t i = 0; i < NKINDS; ++i)
+        if (strlen(KINDS[i].name) == len && strncmp(KINDS[i].name, name, len) == 0) return KINDS[i].bit;
+    return 0;
+}
+
+const char *chub_kind_name(unsigned bit) {
+    for (size_t i = 0; i < NKINDS; ++i) if (KINDS[i].bit == bit) return KINDS[i].name;
+    return NULL;
+}
+
+int chub_facets_parse(const char *query, chub_facets *out, const char **rest,
+                      char *err, size_t err_sz) {
+    memset(out, 0, sizeof(*out));
+    const char *p = query ? query : "";
+    for (;;) {
+        while (*p == ' ') ++p;
+        if (strncmp(p, "type:", 5) != 0 && strncmp(p, "size:", 5) != 0) break;
+        int sizes = p[0] == 's';
+        const char *v = p + 5;
+        const char *end = v + strcspn(v, " ");
+        unsigned any = 0;
+        while (v < end) {
+            const char *comma = memchr(v, ',', (size_t)(end - v));
+            const char *e = comma ? comma : end;
+            unsigned bit = chub_kind_from_name(v, (size_t)(e - v));
+            if (!bit || ((bit & CHUB_KIND_SIZES) != 0) != sizes) {
+                if (err && err_sz) snprintf(err, err_sz, "unknown %s '%.*s'", sizes ? "size" : "type", (int)(e - v), v);
+                return 1;
+            }
+            any |= bit;
+            v = comma ? comma + 1 : end;
+        }
+        if (any) {
+            if (out->n == CHUB_FACET_MAX) {
+                if (err && err_sz) snprintf(err, err_sz, "too many facets (max %d)", CHUB_FACET_MAX);
+                return 2;
+            }
+            out->any[out->n++] = any;
+        }
+        p = end;
+    }
+    if (rest) *rest = p;
+    return 0;
+}
+
+int chub_facets_match(const chub_facets *f, unsigned kind) {
+    for (int i = 0; i < f->n; ++i) if (!(kind & f->any[i])) return 0;
+    return 1;
+}
@@ -1,7 +1,10 @@
 #include "chub/clip.h"
 #include "chub/platform.h"
 #include "chub/util.h"
+#include <stdlib.h>
 #include <string.h>
+#include <windows.h>
+#include <process.h>
 
 /* PowerShell: force UTF-8 output for Get-Clipboard */
 static const char *PS_READ_CMD =
@@ -36,6 +39,233 @@ int chub_clip_write(const char *data) {
     return chub_run_pipe_stdin(PS_WRITE_CMD, data, strlen(data));
 }
 
+/* ----- async writer ----- */
+
+#define SELF_TAGS      8
+#define SELF_TAG_TTL_MS 30000
+
+typedef struct {
+    unsigned long long h;
+    long long ts;           /* 0 = free slot */
+} self_tag;
+
+#define OPEN_RETRIES   10
+#define OPEN_RETRY_MS  10
+#define OWNER_CLASS    "ClipboardHubOwner"
+
+static CRITICAL_SECTION   g_wcs;
+static HANDLE g_wevent = NULL;      /* auto-reset: pending payload or stop */
+static HANDLE g_wthread = NULL;
+static int    g_wstop = 0;
+static char  *g_pending = NULL;     /* newest queued payload (owned) */
+static int    g_pending_seq = 0;
+static int    g_next_seq = 0;
+static volatile LONG g_done_seq = 0;
+static volatile LONG g_done_rc = 0;
+static LONG   g_seen_seq = 0;       /* UI side of chub_clip_writer_poll */
+static self_tag g_tags[SELF_TAGS];
+static int    g_tag_next = 0;
+/* writer thread only: payload we own on the clipboard, rendered on demand */
+static char  *g_owned = NULL;
+
+static void tag_self_write(unsigned long long h) {
+    EnterCriticalSection(&g_wcs);
+    g_tags[g_tag_next].h = h;
+    g_tags[g_tag_next].ts = chub_now_millis();
+    g_tag_next = (g_tag_next + 1) % SELF_TAGS;
+    LeaveCriticalSection(&g_wcs);
+}
+
+/* UTF-8 with LF -> UTF-16 with CRLF, converted segment by segment straight
+   into the clipboard's global block (no intermediate buffers) */
+static HGLOBAL render_unicode(const char *s) {
+    size_t len = strlen(s);
+    if (len > 0x7FFFFFFF) return NULL;
+    int wide = len ? MultiByteToWideChar(CP_UTF8, 0, s, (int)len, NULL, 0) : 0;
+    if (len && wide <= 0) return NULL;
+    size_t lines = 0;
+    for (const char *p = s; (p = memchr(p, '\n', len - (size_t)(p - s))) != NULL; ++p) lines++;
+    HGLOBAL hg = GlobalAlloc(GMEM_MOVEABLE, ((size_t)wide + lines + 1) * sizeof(WCHAR));
+    if (!hg) return NULL;
+    WCHAR *dst = (WCHAR*)GlobalLock(hg);
+    if (!dst) { GlobalFree(hg); return NULL; }
+    const char *p = s, *end = s + len;
+    int left = wide;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *seg_end = nl ? nl : end;
+        int n = seg_end > p ? MultiByteToWideChar(CP_UTF8, 0, p, (int)(seg_end - p), dst, left) : 0;
+        dst += n; left -= n;
+        if (!nl) break;
+        *dst++ = L'\r';
+        *dst++ = L'\n';
+        p = nl + 1;
+    }
+    *dst = 0;
+    GlobalUnlock(hg);
+    return hg;
+}
+
+static LRESULT CALLBACK owner_wndproc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
+    switch (msg) {
+        case WM_RENDERFORMAT:
+            /* a paste in some app: serve the stored entry now */
+            if (wp == CF_UNICODETEXT && g_owned) {
+                HGLOBAL hg = render_unicode(g_owned);
+                if (hg && !SetClipboardData(CF_UNICODETEXT, hg)) GlobalFree(hg);
+            }
+            return 0;
+        case WM_RENDERALLFORMATS:
+            /* we're going away: leave the data behind for other apps */
+            if (g_owned && OpenClipboard(hwnd)) {
+                if (GetClipboardOwner() == hwnd) {
+                    HGLOBAL hg = render_unicode(g_owned);
+                    if (hg && !SetClipboardData(CF_UNICODETEXT, hg)) GlobalFree(hg);
+                }
+                CloseClipboard();
+            }
+            return 0;
+        case WM_DESTROYCLIPBOARD:
+            /* someone else (or our next write) emptied the clipboard */
+            free(g_owned);
+            g_owned = NULL;
+            return 0;
+        default:
+            return DefWindowProcA(hwnd, msg, wp, lp);
+    }
+}
+
+static HWND create_owner_window(void) {
+    WNDCLASSA wc;
+    memset(&wc, 0, sizeof(wc));
+    wc.lpfnWndProc = owner_wndproc;
+    wc.hInstance = GetModuleHandleA(NULL);
+    wc.lpszClassName = OWNER_CLASS;
+    RegisterClassA(&wc);  /* fails harmlessly if already registered */
+    return CreateWindowExA(0, OWNER_CLASS, "", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, wc.hInstance, NULL);
+}
+
+/* take clipboard ownership with delayed rendering; on success data is kept */
+static int native_write(HWND hwnd, char *data) {
+    int opened = 0;
+    for (int i = 0; i < OPEN_RETRIES && !(opened = OpenClipboard(hwnd)); ++i) Sleep(OPEN_RETRY_MS);
+    if (!opened) return 1;
+    int ok = EmptyClipboard() != 0;  /* drops the previous payload via WM_DESTROYCLIPBOARD */
+    if (ok) {
+        g_owned = data;
+        SetClipboardData(CF_UNICODETEXT, NULL);  /* rendered on first paste */
+    }
+    CloseClipboard();
+    return ok ? 0 : 2;
+}
+
+static void pump_messages(void) {
+    MSG m;
+    while (PeekMessageA(&m, NULL, 0, 0, PM_REMOVE)) {
+        TranslateMessage(&m);
+        DispatchMessageA(&m);
+    }
+}
+
+static unsigned __stdcall writer_thread(void *arg) {
+    (void)arg;
+    HWND hwnd = create_owner_window();
+    for (;;) {
+        DWORD w = MsgWaitForMultipleObjects(1, &g_wevent, FALSE, INFINITE, QS_ALLINPUT);
+        if (w != WAIT_OBJECT_0) { pump_messages(); continue; }
+
+        EnterCriticalSection(&g_wcs);
+        char *data = g_pending; int seq = g_pending_seq;
+        int stop = g_wstop;
+        g_pending = NULL;
+        LeaveCriticalSection(&g_wcs);
+        if (!data) {
+            if (stop) break;
+            continue;
+        }
+
+        /* tag before writing so the poller can't observe the new clipboard first */
+        tag_self_write(chub_hash64(data));
+        int rc = hwnd ? native_write(hwnd, data) : 1;
+        if (rc != 0) {
+            /* couldn't own the clipboard in-process: fall back to the helper */
+            rc = chub_clip_write(data);
+            free(data);
+        }
+        InterlockedExchange(&g_done_rc, rc);
+        InterlockedExchange(&g_done_seq, seq);
+        if (stop) SetEvent(g_wevent);  /* drained; loop once more to exit */
+    }
+    if (hwnd) DestroyWindow(hwnd);  /* triggers WM_RENDERALLFORMATS */
+    pump_messages();
+    free(g_owned);
+    g_owned = NULL;
+    return 0;
+}
+
+int chub_clip_writer_start(void) {
+    if (g_wthread) return 0;
+    InitializeCriticalSection(&g_wcs);
+    g_wevent = CreateEventA(NULL, FALSE, FALSE, NULL);
+    if (!g_wevent) { DeleteCriticalSection(&g_wcs); return 1; }
+    g_wstop = 0;
+    g_wthread = (HANDLE)_beginthreadex(NULL, 0, writer_thread, NULL, 0, NULL);
+    if (!g_wthread) {
+        CloseHandle(g_wevent); g_wevent = NULL;
+        DeleteCriticalSection(&g_wcs);
+        return 1;
+    }
+    return 0;
+}
+
+void chub_clip_writer_stop(void) {
+    if (!g_wthread) return;
+    EnterCriticalSection(&g_wcs);
+    g_wstop = 1;
+    LeaveCriticalSection(&g_wcs);
+    SetEvent(g_wevent);
+    WaitForSingleObject(g_wthread, INFINITE);
+    CloseHandle(g_wthread);
+    CloseHandle(g_wevent);
+    g_wthread = NULL; g_wevent = NULL;
+    DeleteCriticalSection(&g_wcs);
+}
+
+int chub_clip_write_async(const char *data) {
+    if (!g_wthread) return -1;
+    char *copy = _strdup(data ? data : "");
+    if (!copy) return -1;
+    EnterCriticalSection(&g_wcs);
+    free(g_pending);  /* coalesce: a newer copy supersedes one not yet started */
+    g_pending = copy;
+    int seq = g_pending_seq = ++g_next_seq;
+    LeaveCriticalSection(&g_wcs);
+    SetEvent(g_wevent);
+    return seq;
+}
+
+int chub_clip_writer_poll(int *out_seq, int *out_rc) {
+    LONG seq = InterlockedCompareExchange(&g_done_seq, 0, 0);
+    if (seq == g_seen_seq) return 0;
+    g_seen_seq = seq;
+    if (out_seq) *out_seq = (int)seq;
+    if (out_rc) *out_rc = (int)InterlockedCompareExchange(&g_done_rc, 0, 0);
+    return 1;
+}
+
+int chub_clip_is_self_write(unsigned long long h) {
+    if (!g_wthread) return 0;
+    int hit = 0;
+    long long now = chub_now_millis();
+    EnterCriticalSection(&g_wcs);
+    for (int i = 0; i < SELF_TAGS; ++i) {
+        if (g_tags[i].ts && now - g_tags[i].ts > SELF_TAG_TTL_MS) g_tags[i].ts = 0;
+        if (g_tags[i].ts && g_tags[i].h == h) { g_tags[i].ts = 0; hit = 1; break; }
+    }
+    LeaveCriticalSection(&g_wcs);
+    return hit;
+}
+
 int chub_clip_smoketest(void) {
     const char *msg = "ClipboardHub smoke ✅";
     if (chub_clip_write(msg) != 0) return 1;
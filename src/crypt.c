@@ -0,0 +1,211 @@
+#include "chub/crypt.h"
+#include <windows.h>
+#include <bcrypt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NONCE_BYTES 12
+#define TAG_BYTES   16
+#define SEAL_MAGIC  'E'
+
+#ifndef STATUS_AUTH_TAG_MISMATCH
+#define STATUS_AUTH_TAG_MISMATCH ((NTSTATUS)0xC000A002L)
+#endif
+
+static BCRYPT_ALG_HANDLE g_aes = NULL;     /* AES in GCM mode */
+static BCRYPT_ALG_HANDLE g_hmac = NULL;    /* HMAC-SHA256 */
+static unsigned char g_data_key[32];       /* AES key */
+static unsigned char g_tag_key[32];        /* HMAC key for tag64/pad64 */
+static unsigned long long g_pad = 0;
+static volatile LONG g_gen = 0;            /* bumped per key; 0 = no key */
+
+/* CNG doesn't promise a key handle is safe to share across threads, so
+   each thread builds its own from the data key (scan workers live for the
+   whole run, so these aren't reclaimed) */
+static _Thread_local BCRYPT_KEY_HANDLE t_key = NULL;
+static _Thread_local LONG t_gen = 0;
+
+static BCRYPT_KEY_HANDLE thread_key(void) {
+    LONG gen = InterlockedCompareExchange(&g_gen, 0, 0);
+    if (!gen) return NULL;
+    if (t_key && t_gen == gen) return t_key;
+    if (t_key) { BCryptDestroyKey(t_key); t_key = NULL; }
+    if (!BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(g_aes, &t_key, NULL, 0, g_data_key,
+                                                   sizeof(g_data_key), 0)))
+        return t_key = NULL;
+    t_gen = gen;
+    return t_key;
+}
+
+static int hmac(BCRYPT_ALG_HANDLE alg, const unsigned char *key, size_t key_len,
+                const void *msg, size_t msg_len, unsigned char out[32]) {
+    BCRYPT_HASH_HANDLE h = NULL;
+    int ok = BCRYPT_SUCCESS(BCryptCreateHash(alg, &h, NULL, 0, (PUCHAR)key, (ULONG)key_len, 0)) &&
+             BCRYPT_SUCCESS(BCryptHashData(h, (PUCHAR)msg, (ULONG)msg_len, 0)) &&
+             BCRYPT_SUCCESS(BCryptFinishHash(h, out, 32, 0));
+    if (h) BCryptDestroyHash(h);
+    return ok ? 0 : 3;
+}
+
+int chub_crypt_random(unsigned char *buf, size_t n) {
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, buf, (ULONG)n, BCRYPT_USE_SYSTEM_PREFERRED_RNG)) ? 0 : 3;
+}
+
+int chub_crypt_derive(const char *passphrase, const unsigned char *salt, size_t salt_len,
+                      unsigned iters, unsigned char key[CHUB_CRYPT_KEY_BYTES]) {
+    if (!passphrase || !*passphrase || !salt || !key || !iters) return 1;
+    BCRYPT_ALG_HANDLE alg = NULL;
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, NULL,
+                                                    BCRYPT_ALG_HANDLE_HMAC_FLAG)))
+        return 3;
+    NTSTATUS st = BCryptDeriveKeyPBKDF2(alg, (PUCHAR)passphrase, (ULONG)strlen(passphrase),
+                                        (PUCHAR)salt, (ULONG)salt_len, iters,
+                                        key, CHUB_CRYPT_KEY_BYTES, 0);
+    BCryptCloseAlgorithmProvider(alg, 0);
+    return BCRYPT_SUCCESS(st) ? 0 : 3;
+}
+
+int chub_crypt_read_keyfile(const char *path, unsigned char key[CHUB_CRYPT_KEY_BYTES]) {
+    if (!path || !key) return 1;
+    FILE *f = fopen(path, "rb");
+    if (!f) return 1;
+    BCRYPT_ALG_HANDLE alg = NULL;
+    BCRYPT_HASH_HANDLE h = NULL;
+    int rc = 3;
+    if (BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&alg, BCRYPT_SHA256_ALGORITHM, NULL, 0)) &&
+        BCRYPT_SUCCESS(BCryptCreateHash(alg, &h, NULL, 0, NULL, 0, 0))) {
+        unsigned char buf[4096];
+        size_t n, total = 0;
+        rc = 0;
+        while (rc == 0 && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+            total += n;
+            if (!BCRYPT_SUCCESS(BCryptHashData(h, buf, (ULONG)n, 0))) rc = 3;
+        }
+        SecureZeroMemory(buf, sizeof(buf));
+        if (rc == 0 && total < CHUB_CRYPT_KEY_BYTES) rc = 4;
+        if (rc == 0 && !BCRYPT_SUCCESS(BCryptFinishHash(h, key, CHUB_CRYPT_KEY_BYTES, 0))) rc = 3;
+    }
+    if (h) BCryptDestroyHash(h);
+    if (alg) BCryptCloseAlgorithmProvider(alg, 0);
+    fclose(f);
+    return rc;
+}
+
+int chub_crypt_set_key(const unsigned char key[CHUB_CRYPT_KEY_BYTES]) {
+    if (!key) return 1;
+    chub_crypt_clear();
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&g_aes, BCRYPT_AES_ALGORITHM, NULL, 0)) ||
+        !BCRYPT_SUCCESS(BCryptSetProperty(g_aes, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM,
+                                          sizeof(BCRYPT_CHAIN_MODE_GCM), 0)) ||
+        !BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&g_hmac, BCRYPT_SHA256_ALGORITHM, NULL,
+                                                    BCRYPT_ALG_HANDLE_HMAC_FLAG))) {
+        chub_crypt_clear();
+        return 3;
+    }
+    /* independent subkeys so the tags never reuse the cipher key */
+    unsigned char pad[32];
+    if (hmac(g_hmac, key, CHUB_CRYPT_KEY_BYTES, "chub data", 9, g_data_key) != 0 ||
+        hmac(g_hmac, key, CHUB_CRYPT_KEY_BYTES, "chub tag", 8, g_tag_key) != 0 ||
+        hmac(g_hmac, g_tag_key, sizeof(g_tag_key), "chub simhash", 12, pad) != 0) {
+        chub_crypt_clear();
+        return 3;
+    }
+    memcpy(&g_pad, pad, sizeof(g_pad));
+    SecureZeroMemory(pad, sizeof(pad));
+    static LONG next_gen = 0;
+    InterlockedExchange(&g_gen, InterlockedIncrement(&next_gen));
+    return 0;
+}
+
+void chub_crypt_clear(void) {
+    InterlockedExchange(&g_gen, 0);
+    if (t_key) { BCryptDestroyKey(t_key); t_key = NULL; }
+    if (g_aes) { BCryptCloseAlgorithmProvider(g_aes, 0); g_aes = NULL; }
+    if (g_hmac) { BCryptCloseAlgorithmProvider(g_hmac, 0); g_hmac = NULL; }
+    SecureZeroMemory(g_data_key, sizeof(g_data_key));
+    SecureZeroMemory(g_tag_key, sizeof(g_tag_key));
+    g_pad = 0;
+}
+
+int chub_crypt_enabled(void) {
+    return InterlockedCompareExchange(&g_gen, 0, 0) != 0;
+}
+
+static void init_auth(BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO *ai, unsigned char *nonce,
+                      unsigned char *aad, unsigned char *tag) {
+    BCRYPT_INIT_AUTH_MODE_INFO(*ai);
+    ai->pbNonce = nonce;
+    ai->cbNonce = NONCE_BYTES;
+    ai->pbAuthData = aad;
+    ai->cbAuthData = 8;
+    ai->pbTag = tag;
+    ai->cbTag = TAG_BYTES;
+}
+
+int chub_crypt_seal(long long id, const void *plain, size_t len,
+                    unsigned char **out, size_t *out_len) {
+    if (!out || !out_len || (!plain && len)) return 1;
+    *out = NULL; *out_len = 0;
+    BCRYPT_KEY_HANDLE key = thread_key();
+    if (!key || len > 0x7FFFFFFF) return 1;
+    unsigned char *p = (unsigned char*)malloc(len + CHUB_CRYPT_OVERHEAD);
+    if (!p) return 4;
+    unsigned char aad[8];
+    memcpy(aad, &id, sizeof(aad));
+    p[0] = SEAL_MAGIC;
+    if (chub_crypt_random(p + 1, NONCE_BYTES) != 0) { free(p); return 3; }
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO ai;
+    init_auth(&ai, p + 1, aad, p + 1 + NONCE_BYTES + len);
+    ULONG done = 0;
+    unsigned char empty = 0;  /* CNG wants a non-NULL input even for zero bytes */
+    NTSTATUS st = BCryptEncrypt(key, len ? (PUCHAR)plain : &empty, (ULONG)len, &ai, NULL, 0,
+                                p + 1 + NONCE_BYTES, (ULONG)len, &done, 0);
+    if (!BCRYPT_SUCCESS(st)) { free(p); return 3; }
+    *out = p;
+    *out_len = len + CHUB_CRYPT_OVERHEAD;
+    return 0;
+}
+
+int chub_crypt_open(long long id, const void *sealed, size_t len,
+                    char **out, size_t *out_len) {
+    if (!out || (!sealed && len)) return 1;
+    *out = NULL;
+    BCRYPT_KEY_HANDLE key = thread_key();
+    if (!key) return 1;
+    const unsigned char *s = (const unsigned char*)sealed;
+    if (len < CHUB_CRYPT_OVERHEAD || s[0] != SEAL_MAGIC) return 2;
+    size_t n = len - CHUB_CRYPT_OVERHEAD;
+    char *p = (char*)malloc(n + 1);
+    if (!p) return 4;
+    unsigned char aad[8], nonce[NONCE_BYTES], tag[TAG_BYTES];
+    memcpy(aad, &id, sizeof(aad));
+    memcpy(nonce, s + 1, NONCE_BYTES);
+    memcpy(tag, s + 1 + NONCE_BYTES + n, TAG_BYTES);
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO ai;
+    init_auth(&ai, nonce, aad, tag);
+    ULONG done = 0;
+    unsigned char empty = 0;
+    NTSTATUS st = BCryptDecrypt(key, n ? (PUCHAR)(s + 1 + NONCE_BYTES) : &empty, (ULONG)n, &ai,
+                                NULL, 0, (PUCHAR)p, (ULONG)n, &done, 0);
+    if (!BCRYPT_SUCCESS(st)) {
+        free(p);
+        return st == STATUS_AUTH_TAG_MISMATCH ? 2 : 3;
+    }
+    p[n] = '\0';
+    *out = p;
+    if (out_len) *out_len = n;
+    return 0;
+}
+
+unsigned long long chub_crypt_tag64(unsigned long long h) {
+    unsigned char mac[32];
+    unsigned long long t = h;
+    if (chub_crypt_enabled() && hmac(g_hmac, g_tag_key, sizeof(g_tag_key), &h, sizeof(h), mac) == 0)
+        memcpy(&t, mac, sizeof(t));
+    return t;
+}
+
+unsigned long long chub_crypt_pad64(void) {
+    return g_pad;
+}
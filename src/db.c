@@ -1,13 +1,38 @@
 #include "chub/db.h"
+#include "chub/classify.h"
+#include "chub/crypt.h"
+#include "chub/delta.h"
+#include "chub/regex.h"
 #include "chub/util.h"
 #include <sqlite3.h>
 #include <windows.h>
 #include <stdio.h>     // <-- added for snprintf
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 static sqlite3 *G = NULL;
+static char g_path[MAX_PATH * 4];
 static CRITICAL_SECTION g_cs;
+static volatile LONG g_ready = 0;  /* schema applied; safe to query from other threads */
+static long long g_deadline = 0;   /* ms; 0 = none. guarded by g_cs */
+static int g_sealed = 0;           /* text payloads are sealed (chub/crypt.h); set in open */
+static int g_sealed_previews = 0;  /* items.preview is sealed too */
+static int g_sync = 0;             /* mutations are appended to the change log */
+static long long g_hlc = 0;        /* last hybrid logical clock value issued; under g_cs */
+static int g_sync_seen = -1;       /* PRAGMA data_version when sync_node was last read */
+
+#define PROGRESS_OPS 1000          /* VDBE ops between deadline checks */
+#define BUSY_TIMEOUT_MS 5000       /* `chub sync` may write while the UI runs */
+#define MAINTAIN_FREE_PAGES   64   /* freelist size that triggers a vacuum step */
+#define MAINTAIN_VACUUM_PAGES 512  /* pages returned per chub_db_maintain() */
+
+#define FACET_COUNT_CAP  4096      /* rows counted per clause to pick the driver */
+
+#define DELTA_MIN_LEN    256       /* shorter captures aren't sketched */
+#define DELTA_MAX_DIST   8         /* SimHash bits for a near-duplicate */
+#define DELTA_MAX_DEPTH  4         /* deltas between an entry and its full-text base */
+#define DELTA_CANDIDATES 2         /* bases tried per insert */
 
 static int exec_sql(const char *sql) {
     char *err = NULL;
@@ -19,53 +44,940 @@ static int exec_sql(const char *sql) {
     return rc;
 }
 
+/* regexp(ptr, text): ptr is a compiled chub_regex bound with sqlite3_bind_pointer */
+static void sql_regexp(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const chub_regex *re = (const chub_regex*)sqlite3_value_pointer(argv[0], "chub_regex");
+    const char *txt = (const char*)sqlite3_value_text(argv[1]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[1]);
+    sqlite3_result_int(ctx, re && txt && chub_regex_match(re, txt, len));
+}
+
+static int progress_cb(void *arg) {
+    (void)arg;
+    return g_deadline && chub_now_millis() > g_deadline;
+}
+
+/* arm the time budget for the statement about to run (under g_cs) */
+static void begin_budget(int budget_ms) {
+    g_deadline = budget_ms > 0 ? chub_now_millis() + budget_ms : 0;
+    sqlite3_progress_handler(G, PROGRESS_OPS, progress_cb, NULL);
+}
+
+static void end_budget(void) {
+    sqlite3_progress_handler(G, 0, NULL, NULL);
+    g_deadline = 0;
+}
+
+/* one (bit, ts, id) row per set kind bit: facet queries walk only the
+   rows of the kind they ask for, newest first */
+static int insert_kind_rows(int id, long long ts, unsigned kind) {
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "INSERT OR IGNORE INTO item_kinds(bit,ts,id) VALUES(?,?,?)", -1, &st, NULL) != SQLITE_OK)
+        return 2;
+    int rc = SQLITE_DONE;
+    for (int b = 0; b < CHUB_KIND_BITS && rc == SQLITE_DONE; ++b) {
+        if (!(kind & (1u << b))) continue;
+        sqlite3_bind_int  (st, 1, 1 << b);
+        sqlite3_bind_int64(st, 2, (sqlite3_int64)ts);
+        sqlite3_bind_int  (st, 3, id);
+        rc = sqlite3_step(st);
+        sqlite3_reset(st);
+    }
+    sqlite3_finalize(st);
+    return rc == SQLITE_DONE ? 0 : 3;
+}
+
+static int has_column(const char *name) {
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT 1 FROM pragma_table_info('items') WHERE name=?", -1, &st, NULL) != SQLITE_OK)
+        return 0;
+    sqlite3_bind_text(st, 1, name, -1, SQLITE_STATIC);
+    int found = sqlite3_step(st) == SQLITE_ROW;
+    sqlite3_finalize(st);
+    return found;
+}
+
+/* add items.kind to older databases and classify rows that predate it */
+static int ensure_kinds(void) {
+    sqlite3_stmt *st = NULL;
+    if (!has_column("kind") && exec_sql("ALTER TABLE items ADD COLUMN kind INTEGER NOT NULL DEFAULT -1;") != SQLITE_OK)
+        return 2;
+
+    const char *schema =
+        "CREATE TABLE IF NOT EXISTS item_kinds ("
+        " bit INTEGER NOT NULL,"
+        " ts INTEGER NOT NULL,"
+        " id INTEGER NOT NULL,"
+        " PRIMARY KEY (bit, ts, id)"
+        ") WITHOUT ROWID;"
+        "CREATE INDEX IF NOT EXISTS idx_item_kinds_id ON item_kinds(id);"
+        "CREATE TRIGGER IF NOT EXISTS items_kinds_ad AFTER DELETE ON items BEGIN"
+        "  DELETE FROM item_kinds WHERE id=OLD.id;"
+        " END;"
+        "CREATE TRIGGER IF NOT EXISTS items_kinds_au AFTER UPDATE OF ts ON items BEGIN"
+        "  UPDATE item_kinds SET ts=NEW.ts WHERE id=NEW.id;"
+        " END;";
+    if (exec_sql(schema) != SQLITE_OK) return 2;
+
+    if (sqlite3_prepare_v2(G, "SELECT id,ts,text FROM items WHERE kind < 0", -1, &st, NULL) != SQLITE_OK)
+        return 2;
+    sqlite3_stmt *up = NULL;
+    if (sqlite3_prepare_v2(G, "UPDATE items SET kind=? WHERE id=?", -1, &up, NULL) != SQLITE_OK) {
+        sqlite3_finalize(st); return 2;
+    }
+    int rc = 0;
+    while (rc == 0 && sqlite3_step(st) == SQLITE_ROW) {
+        int id = sqlite3_column_int(st, 0);
+        long long ts = (long long)sqlite3_column_int64(st, 1);
+        const char *txt = (const char*)sqlite3_column_text(st, 2);
+        unsigned kind = chub_classify(txt, (size_t)sqlite3_column_bytes(st, 2));
+        sqlite3_bind_int(up, 1, (int)kind);
+        sqlite3_bind_int(up, 2, id);
+        if (sqlite3_step(up) != SQLITE_DONE) rc = 3;
+        sqlite3_reset(up);
+        if (rc == 0) rc = insert_kind_rows(id, ts, kind);
+    }
+    sqlite3_finalize(up);
+    sqlite3_finalize(st);
+    return rc;
+}
+
+/* Frecency is kept in log space relative to a fixed origin:
+     frecency = ln(sum_i w_i * 2^(t_i / half_life))
+   Decaying every entry by the same factor doesn't change their order, so
+   the stored value never needs rewriting as time passes; a use only folds
+   one more term in with logaddexp. A fresh capture is one unit-weight use,
+   so entries that were never reused rank exactly by ts. */
+static double frecency_term(long long ts, double weight) {
+    return log(weight) + (double)ts * (0.69314718055994531 / (double)CHUB_FRECENCY_HALF_LIFE_MS);
+}
+
+static double logaddexp(double a, double b) {
+    double hi = a > b ? a : b, lo = a > b ? b : a;
+    return hi + log1p(exp(lo - hi));
+}
+
+static void sql_logaddexp(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    sqlite3_result_double(ctx, logaddexp(sqlite3_value_double(argv[0]), sqlite3_value_double(argv[1])));
+}
+
+/* use counters + frecency for older databases; seeded once from ts */
+static int ensure_frecency(void) {
+    if (!has_column("frecency")) {
+        const char *alter =
+            "ALTER TABLE items ADD COLUMN uses INTEGER NOT NULL DEFAULT 0;"
+            "ALTER TABLE items ADD COLUMN last_used INTEGER NOT NULL DEFAULT 0;"
+            "ALTER TABLE items ADD COLUMN frecency REAL NOT NULL DEFAULT 0;";
+        if (exec_sql(alter) != SQLITE_OK) return 2;
+        sqlite3_stmt *st = NULL;
+        if (sqlite3_prepare_v2(G, "UPDATE items SET frecency = ts * ?", -1, &st, NULL) != SQLITE_OK) return 2;
+        sqlite3_bind_double(st, 1, frecency_term(1, 1.0));
+        int rc = sqlite3_step(st);
+        sqlite3_finalize(st);
+        if (rc != SQLITE_DONE) return 3;
+    }
+    return 0;
+}
+
+static void sql_preview(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *txt = (const char*)sqlite3_value_text(argv[0]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+    if (!txt) { sqlite3_result_text(ctx, "", 0, SQLITE_STATIC); return; }
+    sqlite3_result_text(ctx, txt, (int)chub_utf8_clip(txt, len, CHUB_DB_PREVIEW_MAX), SQLITE_TRANSIENT);
+}
+
+static void sql_simhash(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *txt = (const char*)sqlite3_value_text(argv[0]);
+    size_t len = (size_t)sqlite3_value_bytes(argv[0]);
+    sqlite3_result_int64(ctx, txt ? (sqlite3_int64)chub_simhash(txt, len) : 0);
+}
+
+/* ----- delta-stored text -----
+   item_text rows either hold the text, or base + delta against another
+   row (itself possibly a delta, at most DELTA_MAX_DEPTH deep). With
+   encryption on, whichever of the two is stored is sealed under the row id. */
+
+static int load_text(sqlite3 *db, sqlite3_int64 id, int hops,
+                     char **out, size_t *out_len, int *depth);
+
+static int copy_text(const char *text, size_t len, char **out, size_t *out_len) {
+    *out = (char*)malloc(len + 1);
+    if (!*out) return 4;
+    if (len) memcpy(*out, text, len);
+    (*out)[len] = '\0';
+    *out_len = len;
+    return 0;
+}
+
+static int rebuild_text(sqlite3 *db, sqlite3_int64 id, const char *text, size_t len,
+                        int has_base, sqlite3_int64 base,
+                        const unsigned char *delta, size_t dlen, int hops,
+                        char **out, size_t *out_len) {
+    if (!has_base)
+        return g_sealed ? chub_crypt_open(id, text, len, out, out_len) : copy_text(text, len, out, out_len);
+    if (hops >= DELTA_MAX_DEPTH || !delta) return 2;
+    char *b = NULL, *d = NULL;
+    size_t blen = 0;
+    int rc = g_sealed ? chub_crypt_open(id, delta, dlen, &d, &dlen) : 0;
+    if (rc == 0) rc = load_text(db, base, hops + 1, &b, &blen, NULL);
+    if (rc == 0) rc = chub_delta_apply(b, blen, d ? (const unsigned char*)d : delta, dlen, out, out_len);
+    free(b);
+    free(d);
+    return rc;
+}
+
+static int load_text(sqlite3 *db, sqlite3_int64 id, int hops,
+                     char **out, size_t *out_len, int *depth) {
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT text,base,delta,depth FROM item_text WHERE id=?",
+                           -1, &st, NULL) != SQLITE_OK) return 2;
+    sqlite3_bind_int64(st, 1, id);
+    int rc = sqlite3_step(st);
+    if (rc == SQLITE_ROW) {
+        const unsigned char *d = (const unsigned char*)sqlite3_column_blob(st, 2);
+        rc = rebuild_text(db, id, (const char*)sqlite3_column_blob(st, 0), (size_t)sqlite3_column_bytes(st, 0),
+                          sqlite3_column_type(st, 1) != SQLITE_NULL, sqlite3_column_int64(st, 1),
+                          d, (size_t)sqlite3_column_bytes(st, 2), hops, out, out_len);
+        if (depth) *depth = sqlite3_column_int(st, 3);
+    } else {
+        rc = rc == SQLITE_DONE ? 4 : 3;
+    }
+    sqlite3_finalize(st);
+    return rc;
+}
+
+/* full text from chub_text()'s arguments; NULL after reporting an error */
+static char *text_from_args(sqlite3_context *ctx, sqlite3_value **argv, size_t *len) {
+    const char *txt = (const char*)sqlite3_value_blob(argv[1]);
+    size_t tlen = (size_t)sqlite3_value_bytes(argv[1]);
+    const unsigned char *d = (const unsigned char*)sqlite3_value_blob(argv[3]);
+    size_t dlen = (size_t)sqlite3_value_bytes(argv[3]);
+    char *out = NULL;
+    int rc = rebuild_text(sqlite3_context_db_handle(ctx), sqlite3_value_int64(argv[0]), txt, tlen,
+                          sqlite3_value_type(argv[2]) != SQLITE_NULL, sqlite3_value_int64(argv[2]),
+                          d, dlen, 0, &out, len);
+    if (rc == 4 && !out) { sqlite3_result_error_nomem(ctx); return NULL; }
+    if (rc != 0) {
+        chub_log("DB", "can't read text of entry %lld", (long long)sqlite3_value_int64(argv[0]));
+        sqlite3_result_text(ctx, "", 0, SQLITE_STATIC);
+        return NULL;
+    }
+    return out;
+}
+
+/* chub_text(id, text, base, delta): the full text of an item_text row */
+static void sql_text(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    if (!g_sealed && sqlite3_value_type(argv[2]) == SQLITE_NULL) { sqlite3_result_value(ctx, argv[1]); return; }
+    size_t len = 0;
+    char *txt = text_from_args(ctx, argv, &len);
+    if (txt) sqlite3_result_text(ctx, txt, (int)len, free);
+}
+
+/* chub_stored(id, text, base, delta): the full text as item_text.text
+   stores it, for rewriting a delta row that loses its base */
+static void sql_stored(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    if (sqlite3_value_type(argv[2]) == SQLITE_NULL) { sqlite3_result_value(ctx, argv[1]); return; }
+    size_t len = 0;
+    char *txt = text_from_args(ctx, argv, &len);
+    if (!txt) return;
+    if (!g_sealed) { sqlite3_result_text(ctx, txt, (int)len, free); return; }
+    unsigned char *sealed = NULL;
+    size_t slen = 0;
+    int rc = chub_crypt_seal(sqlite3_value_int64(argv[0]), txt, len, &sealed, &slen);
+    free(txt);
+    if (rc != 0) { sqlite3_result_error(ctx, "chub_stored: seal failed", -1); return; }
+    sqlite3_result_blob(ctx, sealed, (int)slen, free);
+}
+
+/* chub_seal(id, value) / chub_unseal(id, value): for converting rows in place */
+static void sql_seal(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const void *v = sqlite3_value_blob(argv[1]);
+    unsigned char *sealed = NULL;
+    size_t slen = 0;
+    if (chub_crypt_seal(sqlite3_value_int64(argv[0]), v, (size_t)sqlite3_value_bytes(argv[1]), &sealed, &slen) != 0) {
+        sqlite3_result_error(ctx, "chub_seal failed", -1);
+        return;
+    }
+    sqlite3_result_blob(ctx, sealed, (int)slen, free);
+}
+
+static void sql_unseal(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const void *v = sqlite3_value_blob(argv[1]);
+    char *txt = NULL;
+    size_t len = 0;
+    if (chub_crypt_open(sqlite3_value_int64(argv[0]), v, (size_t)sqlite3_value_bytes(argv[1]), &txt, &len) != 0) {
+        sqlite3_result_error(ctx, "chub_unseal failed", -1);
+        return;
+    }
+    sqlite3_result_text(ctx, txt, (int)len, free);
+}
+
+/* chub_tag64(hash), chub_mask64(simhash): see chub/crypt.h */
+static void sql_tag64(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    sqlite3_result_int64(ctx, (sqlite3_int64)chub_crypt_tag64((unsigned long long)sqlite3_value_int64(argv[0])));
+}
+
+static void sql_mask64(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+    (void)argc;
+    unsigned long long v = (unsigned long long)sqlite3_value_int64(argv[0]);
+    sqlite3_result_int64(ctx, (sqlite3_int64)(v ? v ^ chub_crypt_pad64() : 0));
+}
+
+void chub_db_register_functions(struct sqlite3 *db) {
+    sqlite3_create_function(db, "chub_text", 4, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                            NULL, sql_text, NULL, NULL);
+}
+
+typedef struct {
+    int base;
+    int depth;
+    unsigned char *delta;
+    size_t len;
+} delta_pick;
+
+/* smallest delta against a recent near-duplicate, kept only if it at
+   least halves the text. Under g_cs: the LSH is shared with inserts. */
+static void pick_delta_base(const char *text, size_t len, unsigned long long sk, delta_pick *out) {
+    int cands[DELTA_CANDIDATES];
+    int n = chub_lsh_query(sk, DELTA_MAX_DIST, DELTA_MAX_DEPTH, cands, DELTA_CANDIDATES);
+    for (int i = 0; i < n; ++i) {
+        char *base = NULL;
+        size_t blen = 0;
+        int depth = 0;
+        if (load_text(G, cands[i], 0, &base, &blen, &depth) != 0) continue;  /* pruned since */
+        unsigned char *d = NULL;
+        size_t dlen = 0;
+        if (depth < DELTA_MAX_DEPTH && chub_delta_encode(base, blen, text, len, &d, &dlen) == 0 &&
+            dlen * 2 <= len && (!out->delta || dlen < out->len)) {
+            free(out->delta);
+            out->delta = d; out->len = dlen;
+            out->base = cands[i]; out->depth = depth + 1;
+        } else {
+            free(d);
+        }
+        free(base);
+    }
+}
+
+/* the newest sketched entries, oldest added first so the ring keeps order */
+static void rebuild_lsh(void) {
+    chub_lsh_reset();
+    const char *sql =
+        "SELECT i.id,i.simhash,t.depth FROM items i JOIN item_text t ON t.id=i.id "
+        "WHERE i.length >= ? ORDER BY i.id DESC LIMIT ?";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) return;
+    sqlite3_bind_int(st, 1, DELTA_MIN_LEN);
+    sqlite3_bind_int(st, 2, CHUB_LSH_ENTRIES);
+    int ids[CHUB_LSH_ENTRIES], depths[CHUB_LSH_ENTRIES];
+    unsigned long long sks[CHUB_LSH_ENTRIES];
+    int n = 0;
+    while (n < CHUB_LSH_ENTRIES && sqlite3_step(st) == SQLITE_ROW) {
+        ids[n] = sqlite3_column_int(st, 0);
+        sks[n] = (unsigned long long)sqlite3_column_int64(st, 1);
+        depths[n] = sqlite3_column_int(st, 2);
+        n++;
+    }
+    sqlite3_finalize(st);
+    while (n-- > 0) chub_lsh_add(ids[n], sks[n], depths[n]);
+}
+
+/* ----- change log (chub/sync.h) -----
+   Once sync is enabled each mutation appends rows to `changes` in the same
+   transaction, read back from the affected items rows, so a change is
+   logged exactly when it commits. */
+
+/* next clock value: ahead of everything issued or seen, and of the wall clock */
+static long long hlc_tick(long long seen) {
+    long long t = g_hlc + 1;
+    if (seen >= t) t = seen + 1;
+    long long wall = chub_now_millis() << CHUB_HLC_LOGICAL_BITS;
+    if (wall > t) t = wall;
+    return g_hlc = t;
+}
+
+static int pragma_int(const char *sql) {
+    sqlite3_stmt *st = NULL;
+    int v = -1;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) return -1;
+    if (sqlite3_step(st) == SQLITE_ROW) v = sqlite3_column_int(st, 0);
+    sqlite3_finalize(st);
+    return v;
+}
+
+/* logging is on once sync has been enabled, unless the database has been
+   encrypted since; the clock resumes from the last value stored */
+static void load_sync_state(void) {
+    g_sync_seen = pragma_int("PRAGMA data_version;");
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT max(hlc, coalesce((SELECT max(hlc) FROM changes), 0)) "
+                              "FROM sync_node WHERE id=1", -1, &st, NULL) != SQLITE_OK) return;
+    if (sqlite3_step(st) == SQLITE_ROW) {
+        g_sync = !g_sealed;
+        if (sqlite3_column_int64(st, 0) > g_hlc) g_hlc = sqlite3_column_int64(st, 0);
+    }
+    sqlite3_finalize(st);
+}
+
+/* append a change for every items row matching cond (which binds the
+   row key as ?4). Favorites and deletes also record their clock in
+   sync_keys, so an older change merged later doesn't undo them. */
+static int log_changes(int op, int arg, const char *cond, sqlite3_int64 key) {
+    /* `chub sync` may have enabled it since open; data_version only moves
+       when another connection commits, so sync_node is only re-read then */
+    if (!g_sync && !g_sealed && pragma_int("PRAGMA data_version;") != g_sync_seen) load_sync_state();
+    if (!g_sync) return 0;
+    char sql[2][384];
+    int n = 1;
+    snprintf(sql[0], sizeof(sql[0]),
+             "INSERT INTO changes(hlc,op,arg,hash,ts,kind) SELECT ?1,%d,?2,hash,ts,kind FROM items WHERE %s",
+             op, cond);
+    if (op == CHUB_CHANGE_FAVORITE)
+        snprintf(sql[n++], sizeof(sql[0]),
+                 "INSERT INTO sync_keys(hash,fav,fav_hlc) SELECT hash,?2,?1 FROM items WHERE %s"
+                 " ON CONFLICT(hash) DO UPDATE SET fav=excluded.fav, fav_hlc=excluded.fav_hlc", cond);
+    else if (op != CHUB_CHANGE_INSERT)
+        snprintf(sql[n++], sizeof(sql[0]),
+                 "INSERT INTO sync_keys(hash,del_hlc) SELECT hash,?1 FROM items WHERE %s"
+                 " ON CONFLICT(hash) DO UPDATE SET del_hlc=excluded.del_hlc", cond);
+    long long hlc = hlc_tick(0);
+    for (int i = 0; i < n; ++i) {
+        sqlite3_stmt *st = NULL;
+        if (sqlite3_prepare_v2(G, sql[i], -1, &st, NULL) != SQLITE_OK) return 2;
+        sqlite3_bind_int64(st, 1, hlc);
+        sqlite3_bind_int  (st, 2, arg);
+        sqlite3_bind_int64(st, 4, key);
+        int rc = sqlite3_step(st);
+        sqlite3_finalize(st);
+        if (rc != SQLITE_DONE) return 3;
+    }
+    return 0;
+}
+
+/* ----- schema migrations (PRAGMA user_version) ----- */
+
+/* v1: the unversioned layout, one items table holding the text */
+static int migrate_v1(void) {
+    const char *schema =
+        "CREATE TABLE IF NOT EXISTS items ("
+        " id INTEGER PRIMARY KEY,"
+        " ts INTEGER NOT NULL,"
+        " text TEXT NOT NULL,"
+        " hash INTEGER NOT NULL,"
+        " favorite INTEGER NOT NULL DEFAULT 0"
+        ");";
+    if (exec_sql(schema) != SQLITE_OK) return 2;
+    if (ensure_kinds() != 0) return 2;
+    return ensure_frecency();
+}
+
+/* v2: hot metadata + preview in items, bulk text in item_text, so list
+   queries are answered from covering indexes without reading text pages */
+static int migrate_v2(void) {
+    const char *sql =
+        "CREATE TABLE item_text ("
+        " id INTEGER PRIMARY KEY,"
+        " text TEXT NOT NULL"
+        ");"
+        "INSERT INTO item_text(id, text) SELECT id, text FROM items;"
+        "CREATE TABLE items_v2 ("
+        " id INTEGER PRIMARY KEY,"
+        " ts INTEGER NOT NULL,"
+        " hash INTEGER NOT NULL,"
+        " favorite INTEGER NOT NULL DEFAULT 0,"
+        " kind INTEGER NOT NULL DEFAULT -1,"  /* chub/classify.h bits; -1 = not classified yet */
+        " uses INTEGER NOT NULL DEFAULT 0,"   /* copy-backs */
+        " last_used INTEGER NOT NULL DEFAULT 0,"
+        " frecency REAL NOT NULL DEFAULT 0,"  /* see frecency_term() */
+        " length INTEGER NOT NULL DEFAULT 0," /* bytes of the full text */
+        " preview TEXT NOT NULL DEFAULT ''"   /* first CHUB_DB_PREVIEW_MAX bytes */
+        ");"
+        "INSERT INTO items_v2(id,ts,hash,favorite,kind,uses,last_used,frecency,length,preview)"
+        " SELECT id,ts,hash,favorite,kind,uses,last_used,frecency,"
+        "        length(CAST(text AS BLOB)),chub_preview(text) FROM items;"
+        "DROP TABLE items;"
+        "ALTER TABLE items_v2 RENAME TO items;"
+        /* list (newest first), dedup/touch, and favorites+frecency */
+        "CREATE INDEX idx_items_list ON items(ts DESC, favorite, hash, length, preview);"
+        "CREATE INDEX idx_items_hash ON items(hash, ts DESC);"
+        "CREATE INDEX idx_items_rank ON items(favorite DESC, frecency DESC, ts, hash, length, preview);"
+        "CREATE TRIGGER items_ad AFTER DELETE ON items BEGIN"
+        "  DELETE FROM item_text WHERE id=OLD.id;"
+        "  DELETE FROM item_kinds WHERE id=OLD.id;"
+        " END;"
+        "CREATE TRIGGER items_kinds_au AFTER UPDATE OF ts ON items BEGIN"
+        "  UPDATE item_kinds SET ts=NEW.ts WHERE id=NEW.id;"
+        " END;";
+    return exec_sql(sql) == SQLITE_OK ? 0 : 2;
+}
+
+/* v3: near-duplicates stored as a delta against a recent entry. Deleting
+   a base first rewrites its dependents back to full text. */
+static int migrate_v3(void) {
+    char sql[1024];
+    snprintf(sql, sizeof(sql),
+        "ALTER TABLE item_text ADD COLUMN base INTEGER;"  /* item_text id the delta applies to */
+        "ALTER TABLE item_text ADD COLUMN delta BLOB;"    /* chub/delta.h format */
+        "ALTER TABLE item_text ADD COLUMN depth INTEGER NOT NULL DEFAULT 0;"
+        "ALTER TABLE items ADD COLUMN simhash INTEGER NOT NULL DEFAULT 0;"
+        "UPDATE items SET simhash=(SELECT chub_simhash(text) FROM item_text t WHERE t.id=items.id)"
+        " WHERE length >= %d;"
+        "CREATE INDEX idx_item_text_base ON item_text(base) WHERE base IS NOT NULL;"
+        "CREATE TRIGGER item_text_bd BEFORE DELETE ON item_text BEGIN"
+        "  UPDATE item_text SET text=chub_text(text,base,delta), base=NULL, delta=NULL, depth=0"
+        "   WHERE base=OLD.id;"
+        " END;", DELTA_MIN_LEN);
+    return exec_sql(sql) == SQLITE_OK ? 0 : 2;
+}
+
+/* v4: key parameters for encryption at rest (one row once enabled); a
+   base's dependents are rewritten in stored form, sealed or not */
+static int migrate_v4(void) {
+    const char *sql =
+        "CREATE TABLE crypt ("
+        " id INTEGER PRIMARY KEY CHECK (id = 1),"
+        " kdf TEXT NOT NULL,"             /* 'passphrase' or 'keyfile' */
+        " salt BLOB,"
+        " iters INTEGER NOT NULL DEFAULT 0,"
+        " verifier BLOB NOT NULL,"        /* VERIFIER sealed under id 0 */
+        " plain_previews INTEGER NOT NULL DEFAULT 0"
+        ");"
+        "DROP TRIGGER item_text_bd;"
+        "CREATE TRIGGER item_text_bd BEFORE DELETE ON item_text BEGIN"
+        "  UPDATE item_text SET text=chub_stored(id,text,base,delta), base=NULL, delta=NULL, depth=0"
+        "   WHERE base=OLD.id;"
+        " END;";
+    return exec_sql(sql) == SQLITE_OK ? 0 : 2;
+}
+
+/* v5: change log for sync between instances. sync_node exists once sync
+   is enabled; changes keeps this instance's mutations until they are in a
+   segment (AUTOINCREMENT: sequence numbers are never reused); sync_keys
+   holds the clock of the last favorite/delete per content hash for
+   last-writer-wins merges; sync_peers how far each peer has been merged. */
+static int migrate_v5(void) {
+    const char *sql =
+        "CREATE TABLE sync_node ("
+        " id INTEGER PRIMARY KEY CHECK (id = 1),"
+        " node TEXT NOT NULL,"                  /* instance id, hex */
+        " hlc INTEGER NOT NULL DEFAULT 0,"
+        " exported INTEGER NOT NULL DEFAULT 0"  /* last seq written to a segment */
+        ");"
+        "CREATE TABLE changes ("
+        " seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+        " hlc INTEGER NOT NULL,"
+        " op INTEGER NOT NULL,"                 /* CHUB_CHANGE_* */
+        " arg INTEGER NOT NULL DEFAULT 0,"
+        " hash INTEGER NOT NULL,"
+        " ts INTEGER NOT NULL,"
+        " kind INTEGER NOT NULL DEFAULT 0"
+        ");"
+        "CREATE TABLE sync_keys ("
+        " hash INTEGER PRIMARY KEY,"
+        " fav INTEGER NOT NULL DEFAULT 0,"
+        " fav_hlc INTEGER NOT NULL DEFAULT 0,"
+        " del_hlc INTEGER NOT NULL DEFAULT 0"
+        ");"
+        "CREATE TABLE sync_peers ("
+        " node TEXT PRIMARY KEY,"
+        " seq INTEGER NOT NULL"
+        ");";
+    return exec_sql(sql) == SQLITE_OK ? 0 : 2;
+}
+
+static int (*const MIGRATIONS[])(void) = { migrate_v1, migrate_v2, migrate_v3, migrate_v4, migrate_v5 };
+#define SCHEMA_VERSION ((int)(sizeof(MIGRATIONS) / sizeof(MIGRATIONS[0])))
+
+/* each step runs in its own transaction together with its user_version bump */
+static int migrate(void) {
+    int v = pragma_int("PRAGMA user_version;");
+    if (v < 0) return 2;
+    if (v > SCHEMA_VERSION) {
+        chub_log("DB", "schema v%d is newer than this build (v%d)", v, SCHEMA_VERSION);
+        return 2;
+    }
+    for (; v < SCHEMA_VERSION; ++v) {
+        char bump[64];
+        snprintf(bump, sizeof(bump), "PRAGMA user_version=%d;", v + 1);
+        if (exec_sql("BEGIN IMMEDIATE;") != SQLITE_OK) return 2;
+        if (MIGRATIONS[v]() != 0 || exec_sql(bump) != SQLITE_OK) {
+            exec_sql("ROLLBACK;");
+            chub_log("DB", "migration to v%d failed", v + 1);
+            return 2;
+        }
+        if (exec_sql("COMMIT;") != SQLITE_OK) return 2;
+    }
+    /* databases created before auto_vacuum was set need one VACUUM to switch */
+    if (pragma_int("PRAGMA auto_vacuum;") != 2) {
+        exec_sql("PRAGMA auto_vacuum=INCREMENTAL;");
+        exec_sql("VACUUM;");
+    }
+    return 0;
+}
+
+/* ----- encryption at rest ----- */
+
+#define VERIFIER "chub key check"
+
+static chub_db_crypt_config g_crypt_cfg = { NULL, NULL, 0 };
+
+void chub_db_configure_crypt(const chub_db_crypt_config *cfg) {
+    if (cfg) g_crypt_cfg = *cfg;
+}
+
+static int crypt_key(const char *kdf, const unsigned char *salt, size_t salt_len, unsigned iters,
+                     unsigned char key[CHUB_CRYPT_KEY_BYTES]) {
+    if (strcmp(kdf, "keyfile") == 0) {
+        int rc = chub_crypt_read_keyfile(g_crypt_cfg.key_file, key);
+        if (rc == 4) chub_log("DB", "key file %s holds fewer than %d bytes", g_crypt_cfg.key_file, CHUB_CRYPT_KEY_BYTES);
+        else if (rc != 0) chub_log("DB", "can't read key file %s", g_crypt_cfg.key_file);
+        return rc;
+    }
+    return chub_crypt_derive(g_crypt_cfg.passphrase, salt, salt_len, iters, key);
+}
+
+/* first open with a key: seal every stored text, delta and (unless opted
+   out) preview, key the hashes, then VACUUM so no plaintext page survives */
+static int encrypt_in_place(const char *kdf) {
+    unsigned char salt[CHUB_CRYPT_SALT_BYTES], key[CHUB_CRYPT_KEY_BYTES];
+    unsigned iters = strcmp(kdf, "passphrase") == 0 ? CHUB_CRYPT_KDF_ITERS : 0;
+    if (chub_crypt_random(salt, sizeof(salt)) != 0 ||
+        crypt_key(kdf, salt, sizeof(salt), iters, key) != 0) return 3;
+    int rc = chub_crypt_set_key(key);
+    SecureZeroMemory(key, sizeof(key));
+    unsigned char *ver = NULL;
+    size_t ver_len = 0;
+    if (rc != 0 || chub_crypt_seal(0, VERIFIER, strlen(VERIFIER), &ver, &ver_len) != 0) return 3;
+    g_sealed = 1;
+    sqlite3_stmt *st = NULL;
+    rc = exec_sql("BEGIN IMMEDIATE;") == SQLITE_OK ? 0 : 3;
+    if (rc == 0 && sqlite3_prepare_v2(G, "INSERT INTO crypt(id,kdf,salt,iters,verifier,plain_previews) "
+                                         "VALUES(1,?,?,?,?,?)", -1, &st, NULL) != SQLITE_OK) rc = 2;
+    if (rc == 0) {
+        sqlite3_bind_text(st, 1, kdf, -1, SQLITE_STATIC);
+        sqlite3_bind_blob(st, 2, salt, sizeof(salt), SQLITE_STATIC);
+        sqlite3_bind_int (st, 3, (int)iters);
+        sqlite3_bind_blob(st, 4, ver, (int)ver_len, SQLITE_STATIC);
+        sqlite3_bind_int (st, 5, g_crypt_cfg.plain_previews != 0);
+        rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
+    }
+    sqlite3_finalize(st);
+    free(ver);
+    if (rc == 0 && exec_sql(
+            "UPDATE item_text SET text=chub_seal(id,text) WHERE base IS NULL;"
+            "UPDATE item_text SET delta=chub_seal(id,delta) WHERE base IS NOT NULL;"
+            "UPDATE items SET hash=chub_tag64(hash), simhash=chub_mask64(simhash);"
+            /* the change log holds plain hashes, and sync stops once sealed */
+            "DELETE FROM changes; DELETE FROM sync_keys;") != SQLITE_OK) rc = 3;
+    if (rc == 0 && !g_crypt_cfg.plain_previews &&
+        exec_sql("UPDATE items SET preview=chub_seal(id,preview);") != SQLITE_OK) rc = 3;
+    if (rc != 0) {
+        exec_sql("ROLLBACK;");
+        g_sealed = 0;
+        chub_crypt_clear();
+        return rc;
+    }
+    if (exec_sql("COMMIT;") != SQLITE_OK) return 3;
+    exec_sql("VACUUM;");
+    exec_sql("PRAGMA wal_checkpoint(TRUNCATE);");
+    chub_log("INFO", "database encrypted (%s)", kdf);
+    return 0;
+}
+
+/* 0: no encryption, or the key checks out. 3: a key is missing or wrong */
+static int setup_crypt(void) {
+    int have_key = (g_crypt_cfg.passphrase && *g_crypt_cfg.passphrase) || g_crypt_cfg.key_file;
+    const char *kdf = g_crypt_cfg.key_file ? "keyfile" : "passphrase";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT kdf,salt,iters,verifier,plain_previews FROM crypt WHERE id=1",
+                           -1, &st, NULL) != SQLITE_OK) return 2;
+    if (sqlite3_step(st) != SQLITE_ROW) {
+        sqlite3_finalize(st);
+        return have_key ? encrypt_in_place(kdf) : 0;
+    }
+    if (!have_key) {
+        sqlite3_finalize(st);
+        chub_log("DB", "database is encrypted; set CHUB_PASSPHRASE or pass --key-file");
+        return 3;
+    }
+    const char *stored_kdf = (const char*)sqlite3_column_text(st, 0);
+    unsigned char key[CHUB_CRYPT_KEY_BYTES];
+    int rc = 3;
+    if (strcmp(stored_kdf, kdf) != 0) {
+        chub_log("DB", "database was encrypted with a %s; pass the same kind of key", stored_kdf);
+    } else if (crypt_key(kdf, (const unsigned char*)sqlite3_column_blob(st, 1), (size_t)sqlite3_column_bytes(st, 1),
+                         (unsigned)sqlite3_column_int(st, 2), key) == 0) {
+        rc = chub_crypt_set_key(key) == 0 ? 0 : 3;
+        SecureZeroMemory(key, sizeof(key));
+        char *check = NULL;
+        if (rc == 0 && (chub_crypt_open(0, sqlite3_column_blob(st, 3), (size_t)sqlite3_column_bytes(st, 3), &check, NULL) != 0 ||
+                        strcmp(check, VERIFIER) != 0)) {
+            chub_log("DB", "wrong passphrase or key file");
+            rc = 3;
+        }
+        free(check);
+    }
+    int plain_previews = sqlite3_column_int(st, 4);
+    sqlite3_finalize(st);
+    if (rc != 0) { chub_crypt_clear(); return rc; }
+    g_sealed = 1;
+    g_sealed_previews = !plain_previews;
+    if (plain_previews != (g_crypt_cfg.plain_previews != 0)) {
+        /* the flag changed since last run: convert the previews */
+        char sql[160];
+        snprintf(sql, sizeof(sql),
+                 "BEGIN IMMEDIATE; UPDATE items SET preview=%s(id,preview);"
+                 " UPDATE crypt SET plain_previews=%d; COMMIT;",
+                 plain_previews ? "chub_seal" : "chub_unseal", !plain_previews);
+        if (exec_sql(sql) != SQLITE_OK) { exec_sql("ROLLBACK;"); return 0; }  /* keep the stored mode */
+        g_sealed_previews = plain_previews;
+    }
+    return 0;
+}
+
+/* ----- storage tuning ----- */
+
+static chub_db_config g_cfg = CHUB_DB_CONFIG_DEFAULT;
+
+void chub_db_configure(const chub_db_config *cfg) {
+    if (cfg) g_cfg = *cfg;
+}
+
+void chub_db_apply_pragmas(struct sqlite3 *db) {
+    char sql[160];
+    snprintf(sql, sizeof(sql),
+             "PRAGMA mmap_size=%lld; PRAGMA cache_size=-%d; PRAGMA temp_store=%d;",
+             g_cfg.mmap_size, g_cfg.cache_kib, g_cfg.temp_store);
+    sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+int chub_db_maintain(void) {
+    if (!G) return 1;
+    EnterCriticalSection(&g_cs);
+    int free_pages = pragma_int("PRAGMA freelist_count;");
+    int rc = SQLITE_OK;
+    if (free_pages > MAINTAIN_FREE_PAGES) {
+        char sql[64];
+        snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d);", MAINTAIN_VACUUM_PAGES);
+        rc = exec_sql(sql);
+    }
+    if (rc == SQLITE_OK) rc = exec_sql("PRAGMA optimize;");
+    LeaveCriticalSection(&g_cs);
+    return rc == SQLITE_OK ? 0 : 3;
+}
+
 int chub_db_open(const char *path) {
     if (G) return 0;
     InitializeCriticalSection(&g_cs);
+    snprintf(g_path, sizeof(g_path), "%s", path);
     int rc = sqlite3_open(path, &G);
     if (rc != SQLITE_OK) {
         chub_log("DB", "open failed: %s", sqlite3_errmsg(G));
         sqlite3_close(G); G = NULL;
+        DeleteCriticalSection(&g_cs);
         return 1;
     }
+    exec_sql("PRAGMA auto_vacuum=INCREMENTAL;");  /* only takes effect on a new file */
     exec_sql("PRAGMA journal_mode=WAL;");
     exec_sql("PRAGMA synchronous=NORMAL;");
-    const char *schema =
-        "CREATE TABLE IF NOT EXISTS items ("
-        " id INTEGER PRIMARY KEY,"
-        " ts INTEGER NOT NULL,"
-        " text TEXT NOT NULL,"
-        " hash INTEGER NOT NULL,"
-        " favorite INTEGER NOT NULL DEFAULT 0"
-        ");"
-        "CREATE INDEX IF NOT EXISTS idx_items_ts ON items(ts DESC);"
-        "CREATE INDEX IF NOT EXISTS idx_items_hash ON items(hash);";
-    if (exec_sql(schema) != SQLITE_OK) return 2;
+    sqlite3_busy_timeout(G, BUSY_TIMEOUT_MS);
+    chub_db_apply_pragmas(G);
+    sqlite3_create_function(G, "chub_logaddexp", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                            NULL, sql_logaddexp, NULL, NULL);
+    sqlite3_create_function(G, "chub_regexp", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                            NULL, sql_regexp, NULL, NULL);
+    sqlite3_create_function(G, "chub_preview", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                            NULL, sql_preview, NULL, NULL);
+    sqlite3_create_function(G, "chub_simhash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                            NULL, sql_simhash, NULL, NULL);
+    sqlite3_create_function(G, "chub_stored", 4, SQLITE_UTF8, NULL, sql_stored, NULL, NULL);
+    sqlite3_create_function(G, "chub_seal", 2, SQLITE_UTF8, NULL, sql_seal, NULL, NULL);
+    sqlite3_create_function(G, "chub_unseal", 2, SQLITE_UTF8, NULL, sql_unseal, NULL, NULL);
+    sqlite3_create_function(G, "chub_tag64", 1, SQLITE_UTF8, NULL, sql_tag64, NULL, NULL);
+    sqlite3_create_function(G, "chub_mask64", 1, SQLITE_UTF8, NULL, sql_mask64, NULL, NULL);
+    chub_db_register_functions(G);
+    if (migrate() != 0) {
+        sqlite3_close(G); G = NULL;
+        DeleteCriticalSection(&g_cs);
+        return 2;
+    }
+    if ((rc = setup_crypt()) != 0) {
+        /* nothing may read ciphertext as if it were text */
+        sqlite3_close(G); G = NULL;
+        DeleteCriticalSection(&g_cs);
+        return rc;
+    }
+    if (g_sealed) exec_sql("PRAGMA secure_delete=ON;");  /* zero freed pages: previews, metadata */
+    load_sync_state();
+    rebuild_lsh();
+    InterlockedExchange(&g_ready, 1);
     return 0;
 }
 
+int chub_db_ready(void) {
+    return InterlockedCompareExchange(&g_ready, 0, 0) != 0;
+}
+
+const char *chub_db_path(void) {
+    return chub_db_ready() ? g_path : NULL;
+}
+
 void chub_db_close(void) {
     if (!G) return;
+    InterlockedExchange(&g_ready, 0);
     EnterCriticalSection(&g_cs);
+    exec_sql("PRAGMA optimize;");
     sqlite3_close(G);
     G = NULL;
+    g_sealed = g_sealed_previews = 0;
+    g_sync = 0;
+    g_sync_seen = -1;
+    g_hlc = 0;
+    chub_crypt_clear();
     LeaveCriticalSection(&g_cs);
     DeleteCriticalSection(&g_cs);
 }
 
-int chub_db_insert(const char *text, unsigned long long h, long long ts) {
+/* the row, its text and kind rows; caller holds g_cs and has a transaction open */
+static int insert_locked(const char *text, unsigned long long h, long long ts, unsigned kind, int *out_id) {
+    size_t len = strlen(text);
+    unsigned long long sk = len >= DELTA_MIN_LEN ? chub_simhash(text, len) : 0;
+    const char *sql =
+        "INSERT INTO items(ts,hash,kind,frecency,length,preview,simhash) VALUES(?,?,?,?,?,?,?)";
+    sqlite3_stmt *st = NULL, *tx = NULL, *pv = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(G, "INSERT INTO item_text(id,text,base,delta,depth) VALUES(?,?,?,?,?)",
+                           -1, &tx, NULL) != SQLITE_OK ||
+        (g_sealed_previews &&
+         sqlite3_prepare_v2(G, "UPDATE items SET preview=? WHERE id=?", -1, &pv, NULL) != SQLITE_OK)) {
+        sqlite3_finalize(st);
+        sqlite3_finalize(tx);
+        return 2;
+    }
+    if (g_sealed) {
+        h = chub_crypt_tag64(h);
+        if (sk) sk ^= chub_crypt_pad64();
+    }
+    size_t preview_len = chub_utf8_clip(text, len, CHUB_DB_PREVIEW_MAX);
+    sqlite3_bind_int64 (st, 1, (sqlite3_int64)ts);
+    sqlite3_bind_int64 (st, 2, (sqlite3_int64)h);
+    sqlite3_bind_int   (st, 3, (int)kind);
+    sqlite3_bind_double(st, 4, frecency_term(ts, 1.0));
+    sqlite3_bind_int64 (st, 5, (sqlite3_int64)len);
+    if (pv) sqlite3_bind_text(st, 6, "", 0, SQLITE_STATIC);  /* sealed below, once the id is known */
+    else    sqlite3_bind_text(st, 6, text, (int)preview_len, SQLITE_TRANSIENT);
+    sqlite3_bind_int64 (st, 7, (sqlite3_int64)sk);
+    delta_pick pick = { 0, 0, NULL, 0 };
+    if (sk) pick_delta_base(text, len, sk, &pick);
+    int rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
+    int id = (int)sqlite3_last_insert_rowid(G);
+    /* sealed under the row id: the stored payload (text or delta) and the preview */
+    unsigned char *payload = NULL, *preview = NULL;
+    size_t payload_len = 0, sealed_preview_len = 0;
+    if (rc == 0 && g_sealed &&
+        (chub_crypt_seal(id, pick.delta ? (const void*)pick.delta : text, pick.delta ? pick.len : len,
+                         &payload, &payload_len) != 0 ||
+         (pv && chub_crypt_seal(id, text, preview_len, &preview, &sealed_preview_len) != 0)))
+        rc = 3;
+    if (rc == 0 && pv) {
+        sqlite3_bind_blob(pv, 1, preview, (int)sealed_preview_len, SQLITE_STATIC);
+        sqlite3_bind_int (pv, 2, id);
+        rc = sqlite3_step(pv) == SQLITE_DONE ? 0 : 3;
+    }
+    if (rc == 0) {
+        sqlite3_bind_int(tx, 1, id);
+        if (pick.delta) {
+            sqlite3_bind_text(tx, 2, "", 0, SQLITE_STATIC);
+            sqlite3_bind_int (tx, 3, pick.base);
+            if (payload) sqlite3_bind_blob(tx, 4, payload, (int)payload_len, SQLITE_STATIC);
+            else         sqlite3_bind_blob(tx, 4, pick.delta, (int)pick.len, SQLITE_STATIC);
+            sqlite3_bind_int (tx, 5, pick.depth);
+        } else {
+            if (payload) sqlite3_bind_blob(tx, 2, payload, (int)payload_len, SQLITE_STATIC);
+            else         sqlite3_bind_text(tx, 2, text, (int)len, SQLITE_TRANSIENT);
+            sqlite3_bind_null(tx, 3);
+            sqlite3_bind_null(tx, 4);
+            sqlite3_bind_int (tx, 5, 0);
+        }
+        rc = sqlite3_step(tx) == SQLITE_DONE ? 0 : 3;
+    }
+    sqlite3_finalize(st);
+    sqlite3_finalize(tx);
+    sqlite3_finalize(pv);
+    free(payload);
+    free(preview);
+    if (rc == 0) rc = insert_kind_rows(id, ts, kind);
+    /* a rolled-back id left in the ring only wastes a candidate: bases are re-read */
+    if (rc == 0 && sk) chub_lsh_add(id, sk, pick.depth);
+    free(pick.delta);
+    if (out_id) *out_id = id;
+    return rc;
+}
+
+int chub_db_insert(const char *text, unsigned long long h, long long ts, unsigned kind) {
     if (!G || !text) return 1;
     EnterCriticalSection(&g_cs);
-    const char *sql = "INSERT INTO items(ts,text,hash) VALUES(?,?,?)";
+    exec_sql("BEGIN;");
+    int id = 0;
+    int rc = insert_locked(text, h, ts, kind, &id);
+    if (rc == 0) rc = log_changes(CHUB_CHANGE_INSERT, 0, "id=?4", id);
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
+    LeaveCriticalSection(&g_cs);
+    return rc;
+}
+
+int chub_db_touch(unsigned long long h, long long ts) {
+    if (!G) return 1;
+    EnterCriticalSection(&g_cs);
+    const char *sql =
+        "UPDATE items SET ts=? WHERE id=("
+        "  SELECT id FROM items WHERE hash=? ORDER BY ts DESC LIMIT 1"
+        ")";
     sqlite3_stmt *st = NULL;
     if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
+    if (g_sealed) h = chub_crypt_tag64(h);
     sqlite3_bind_int64(st, 1, (sqlite3_int64)ts);
-    sqlite3_bind_text (st, 2, text, -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int64(st, 3, (sqlite3_int64)h);
+    sqlite3_bind_int64(st, 2, (sqlite3_int64)h);
+    exec_sql("BEGIN;");
+    int rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
+    int changed = sqlite3_changes(G);
+    sqlite3_finalize(st);
+    /* logged as a capture: peers move their copy to the new time */
+    if (rc == 0 && changed > 0)
+        rc = log_changes(CHUB_CHANGE_INSERT, 0,
+                         "id=(SELECT id FROM items WHERE hash=?4 ORDER BY ts DESC LIMIT 1)", (sqlite3_int64)h);
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0) return rc;
+    return changed > 0 ? 0 : 4;
+}
+
+int chub_db_record_use(int id, long long ts) {
+    if (!G) return 1;
+    EnterCriticalSection(&g_cs);
+    const char *sql =
+        "UPDATE items SET uses=uses+1, last_used=?, frecency=chub_logaddexp(frecency, ?) "
+        "WHERE id=?";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
+    sqlite3_bind_int64 (st, 1, (sqlite3_int64)ts);
+    sqlite3_bind_double(st, 2, frecency_term(ts, CHUB_FRECENCY_USE_WEIGHT));
+    sqlite3_bind_int   (st, 3, id);
     int rc = sqlite3_step(st);
+    int changed = sqlite3_changes(G);
     sqlite3_finalize(st);
     LeaveCriticalSection(&g_cs);
-    return rc == SQLITE_DONE ? 0 : 3;
+    if (rc != SQLITE_DONE) return 3;
+    return changed > 0 ? 0 : 4;
 }
 
 int chub_db_mark_favorite(int id, int fav) {
@@ -76,10 +988,13 @@ int chub_db_mark_favorite(int id, int fav) {
     if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
     sqlite3_bind_int(st, 1, fav ? 1 : 0);
     sqlite3_bind_int(st, 2, id);
-    int rc = sqlite3_step(st);
+    exec_sql("BEGIN;");
+    int rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
     sqlite3_finalize(st);
+    if (rc == 0) rc = log_changes(CHUB_CHANGE_FAVORITE, fav ? 1 : 0, "id=?4", id);
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
     LeaveCriticalSection(&g_cs);
-    return rc == SQLITE_DONE ? 0 : 3;
+    return rc;
 }
 
 int chub_db_delete(int id) {
@@ -89,10 +1004,14 @@ int chub_db_delete(int id) {
     sqlite3_stmt *st = NULL;
     if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
     sqlite3_bind_int(st, 1, id);
-    int rc = sqlite3_step(st);
+    exec_sql("BEGIN;");
+    /* logged first: the change row is read from the entry */
+    int rc = log_changes(CHUB_CHANGE_DELETE, 0, "id=?4", id);
+    if (rc == 0) rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
     sqlite3_finalize(st);
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
     LeaveCriticalSection(&g_cs);
-    return rc == SQLITE_DONE ? 0 : 3;
+    return rc;
 }
 
 int chub_db_prune(int keep_limit) {
@@ -105,82 +1024,681 @@ int chub_db_prune(int keep_limit) {
     sqlite3_stmt *st = NULL;
     if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
     sqlite3_bind_int(st, 1, keep_limit);
-    int rc = sqlite3_step(st);
+    exec_sql("BEGIN;");
+    int rc = log_changes(CHUB_CHANGE_PRUNE, 0,
+                         "id NOT IN (SELECT id FROM items ORDER BY ts DESC LIMIT ?4)", keep_limit);
+    if (rc == 0) rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
     sqlite3_finalize(st);
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
     LeaveCriticalSection(&g_cs);
-    return rc == SQLITE_DONE ? 0 : 3;
+    return rc;
 }
 
-static chub_item *alloc_items(int cap) {
-    chub_item *arr = (chub_item*)calloc((size_t)cap, sizeof(chub_item));
-    return arr;
+/* "%needle%" with % _ and \ escaped, so the needle is matched literally as
+   chub_scan_match_substring does; 0 if it doesn't fit */
+static int like_contains(const char *needle, char *out, size_t out_sz) {
+    size_t w = 0;
+    if (out_sz < 3) return 0;
+    out[w++] = '%';
+    for (; *needle; ++needle) {
+        if (w + 3 >= out_sz) return 0;
+        if (*needle == '%' || *needle == '_' || *needle == '\\') out[w++] = '\\';
+        out[w++] = *needle;
+    }
+    out[w++] = '%';
+    out[w] = '\0';
+    return 1;
+}
+
+/* result-set rows carry the preview; full text is fetched on demand */
+#define RS_COLUMNS   "id,ts,preview,favorite,hash,length"
+#define RS_COLUMNS_I "i.id,i.ts,i.preview,i.favorite,i.hash,i.length"
+
+static int push_row(sqlite3_stmt *st, chub_resultset *rs) {
+    const char *txt = (const char*)sqlite3_column_blob(st, 2);
+    size_t len = (size_t)sqlite3_column_bytes(st, 2);
+    char *plain = NULL;
+    if (g_sealed_previews) {
+        if (chub_crypt_open(sqlite3_column_int64(st, 0), txt, len, &plain, &len) != 0) return 4;
+        txt = plain;
+    }
+    int rc = chub_rs_push_preview(rs, sqlite3_column_int(st, 0),
+                                  (long long)sqlite3_column_int64(st, 1),
+                                  sqlite3_column_int(st, 3),
+                                  (unsigned long long)sqlite3_column_int64(st, 4),
+                                  txt, len, (size_t)sqlite3_column_int64(st, 5));
+    free(plain);
+    return rc;
 }
 
-static void fill_item(sqlite3_stmt *st, chub_item *dst) {
-    dst->id       = sqlite3_column_int(st, 0);
-    dst->ts       = (long long)sqlite3_column_int64(st, 1);
-    const unsigned char *utxt = sqlite3_column_text(st, 2);
-    const int fav = sqlite3_column_int(st, 3);
-    const unsigned long long h = (unsigned long long)sqlite3_column_int64(st, 4);
-    size_t len = utxt ? strlen((const char*)utxt) : 0;
-    dst->text = (char*)malloc(len + 1);
-    if (dst->text) {
-        if (len) memcpy(dst->text, (const char*)utxt, len);
-        dst->text[len] = '\0';
+/* rows are RS_COLUMNS; appended straight into the arena */
+static int step_into_rs(sqlite3_stmt *st, int limit, chub_resultset *rs) {
+    int rc = SQLITE_DONE;
+    while (chub_rs_count(rs) < limit && (rc = sqlite3_step(st)) == SQLITE_ROW) {
+        if (push_row(st, rs) != 0) return 4;
     }
-    dst->favorite = fav;
-    dst->h = h;
+    return rc == SQLITE_INTERRUPT ? 5 : 0;
 }
 
-int chub_db_fetch_recent(int limit, chub_item **out_arr, int *out_count) {
-    if (!G || !out_arr || !out_count || limit <= 0) return 1;
-    *out_arr = NULL; *out_count = 0;
+int chub_db_fetch_recent_rs(int limit, chub_resultset **out) {
+    if (!G || !out || limit <= 0) return 1;
+    *out = NULL;
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) return 4;
     EnterCriticalSection(&g_cs);
-    const char *sql = "SELECT id,ts,text,favorite,hash FROM items ORDER BY ts DESC LIMIT ?";
+    /* answered from idx_items_list alone */
+    const char *sql = "SELECT " RS_COLUMNS " FROM items ORDER BY ts DESC LIMIT ?";
     sqlite3_stmt *st = NULL;
-    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
-    sqlite3_bind_int(st, 1, limit);
-    chub_item *arr = alloc_items(limit);
-    int n = 0;
-    int rc;
-    while ((rc = sqlite3_step(st)) == SQLITE_ROW && n < limit) {
-        fill_item(st, &arr[n++]);
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 2;
     }
+    sqlite3_bind_int(st, 1, limit);
+    int rc = step_into_rs(st, limit, rs);
     sqlite3_finalize(st);
     LeaveCriticalSection(&g_cs);
-    if (n == 0) { free(arr); return 0; }
-    *out_arr = arr; *out_count = n;
+    if (rc != 0) { chub_rs_free(rs); return rc; }
+    *out = rs;
     return 0;
 }
 
-int chub_db_search(const char *needle, int limit, chub_item **out_arr, int *out_count) {
-    if (!G || !needle || !out_arr || !out_count || limit <= 0) return 1;
-    *out_arr = NULL; *out_count = 0;
+int chub_db_fetch_ranked_rs(int limit, chub_resultset **out) {
+    if (!G || !out || limit <= 0) return 1;
+    *out = NULL;
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) return 4;
     EnterCriticalSection(&g_cs);
+    /* answered from idx_items_rank alone; no score is computed per row */
     const char *sql =
-        "SELECT id,ts,text,favorite,hash FROM items "
-        "WHERE text LIKE ? ESCAPE '\\' "
-        "ORDER BY ts DESC LIMIT ?";
+        "SELECT " RS_COLUMNS " FROM items "
+        "ORDER BY favorite DESC, frecency DESC LIMIT ?";
     sqlite3_stmt *st = NULL;
-    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 2;
+    }
+    sqlite3_bind_int(st, 1, limit);
+    int rc = step_into_rs(st, limit, rs);
+    sqlite3_finalize(st);
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0) { chub_rs_free(rs); return rc; }
+    *out = rs;
+    return 0;
+}
+
+int chub_db_search_rs(const char *needle, int limit, chub_resultset **out) {
+    if (!G || !needle || !out || limit <= 0) return 1;
+    *out = NULL;
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) return 4;
+    EnterCriticalSection(&g_cs);
+    const char *sql =
+        "SELECT " RS_COLUMNS_I " FROM items i JOIN item_text t ON t.id=i.id "
+        "WHERE " CHUB_DB_TEXT_SQL " LIKE ? ESCAPE '\\' "
+        "ORDER BY i.ts DESC LIMIT ?";
     char pat[1024];
-    snprintf(pat, sizeof(pat), "%%%s%%", needle);
+    if (!like_contains(needle, pat, sizeof(pat))) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 1;
+    }
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 2;
+    }
     sqlite3_bind_text(st, 1, pat, -1, SQLITE_TRANSIENT);
     sqlite3_bind_int (st, 2, limit);
-    chub_item *arr = alloc_items(limit);
-    int n = 0, rc;
-    while ((rc = sqlite3_step(st)) == SQLITE_ROW && n < limit) {
-        fill_item(st, &arr[n++]);
+    int rc = step_into_rs(st, limit, rs);
+    sqlite3_finalize(st);
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0) { chub_rs_free(rs); return rc; }
+    *out = rs;
+    return 0;
+}
+
+int chub_db_search_regex(const char *pattern, int limit, int budget_ms,
+                         chub_resultset **out, char *err, size_t err_sz) {
+    if (!G || !pattern || !out || limit <= 0) return 1;
+    *out = NULL;
+    chub_regex *re = NULL;
+    if (chub_regex_compile(pattern, &re, err, err_sz) != 0) return 6;
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) { chub_regex_free(re); return 4; }
+    EnterCriticalSection(&g_cs);
+    const char *sql =
+        "SELECT " RS_COLUMNS_I " FROM items i JOIN item_text t ON t.id=i.id "
+        "WHERE chub_regexp(?, " CHUB_DB_TEXT_SQL ") "
+        "ORDER BY i.ts DESC LIMIT ?";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); chub_regex_free(re); return 2;
+    }
+    sqlite3_bind_pointer(st, 1, re, "chub_regex", NULL);
+    sqlite3_bind_int(st, 2, limit);
+    begin_budget(budget_ms);
+    int rc = step_into_rs(st, limit, rs);
+    end_budget();
+    sqlite3_finalize(st);
+    LeaveCriticalSection(&g_cs);
+    chub_regex_free(re);
+    if (rc != 0 && rc != 5) { chub_rs_free(rs); return rc; }
+    *out = rs;
+    return rc;
+}
+
+typedef struct {
+    int id;
+    long long ts;
+    double score;
+} kind_hit;
+
+static int cmp_kind_hits(const void *a, const void *b) {
+    const kind_hit *x = (const kind_hit*)a, *y = (const kind_hit*)b;
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return x->ts < y->ts ? 1 : x->ts > y->ts ? -1 : 0;
+}
+
+/* item_kinds rows for any of bits, counted up to cap: enough to tell a
+   rare clause from a common one without walking the common one */
+static int kind_rows(unsigned bits, int cap) {
+    char sql[256];
+    size_t w = (size_t)snprintf(sql, sizeof(sql), "SELECT count(*) FROM (SELECT 1 FROM item_kinds WHERE bit IN (");
+    for (int b = 0; b < CHUB_KIND_BITS; ++b)
+        if (bits & (1u << b)) w += (size_t)snprintf(sql + w, sizeof(sql) - w, "%s%d", sql[w - 1] == '(' ? "" : ",", 1 << b);
+    snprintf(sql + w, sizeof(sql) - w, ") LIMIT %d)", cap);
+    int n = pragma_int(sql);
+    return n < 0 ? cap : n;
+}
+
+int chub_db_search_kinds(const unsigned *clauses, int nclauses,
+                         chub_db_match_fn match, void *ctx, int order,
+                         int limit, int budget_ms, chub_resultset **out) {
+    if (!G || !clauses || nclauses <= 0 || !out || limit <= 0) return 1;
+    *out = NULL;
+
+    /* one index walk per bit of the driving clause, merged newest first by
+       SQLite (MERGE UNION ALL) so the walk stops at LIMIT; the other
+       clauses are checked on items.kind */
+    static const char *ARM =
+        "SELECT " RS_COLUMNS_I ",i.kind,k.bit," CHUB_DB_RANK_SQL ",k.ts,k.id "
+        "FROM item_kinds k JOIN items i ON i.id=k.id WHERE k.bit=%d";
+    char sql[CHUB_KIND_BITS * 256 + 64];
+
+    chub_resultset *rs = chub_rs_new();
+    kind_hit *hits = NULL;
+    int nhits = 0, caphits = 0;
+    if (!rs) return 4;
+    EnterCriticalSection(&g_cs);
+    /* drive from the clause with the fewest rows */
+    unsigned drive = clauses[0];
+    if (nclauses > 1) {
+        int best = kind_rows(drive, FACET_COUNT_CAP);
+        for (int i = 1; i < nclauses && best > 0; ++i) {
+            int n = kind_rows(clauses[i], best);
+            if (n < best) { best = n; drive = clauses[i]; }
+        }
+    }
+    size_t w = 0;
+    sql[0] = '\0';
+    for (int b = 0; b < CHUB_KIND_BITS; ++b) {
+        if (!(drive & (1u << b))) continue;
+        if (w) w += (size_t)snprintf(sql + w, sizeof(sql) - w, " UNION ALL ");
+        w += (size_t)snprintf(sql + w, sizeof(sql) - w, ARM, 1 << b);
+    }
+    snprintf(sql + w, sizeof(sql) - w, " ORDER BY 10 DESC, 11 DESC");
+
+    sqlite3_stmt *st = NULL, *tx = NULL;  /* text only for rows that pass the facets */
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK ||
+        (match && sqlite3_prepare_v2(G, "SELECT " CHUB_DB_TEXT_SQL " FROM item_text t WHERE id=?",
+                                    -1, &tx, NULL) != SQLITE_OK)) {
+        sqlite3_finalize(st);
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 2;
+    }
+    begin_budget(budget_ms);
+    int rc = 0, step, rows = 0;
+    while ((step = sqlite3_step(st)) == SQLITE_ROW) {
+        if (++rows % 256 == 0 && progress_cb(NULL)) { rc = 5; break; }
+        unsigned kind = (unsigned)sqlite3_column_int(st, 6);
+        unsigned bit = (unsigned)sqlite3_column_int(st, 7);
+        /* a row with several driver bits appears once per bit; keep the lowest */
+        unsigned mine = kind & drive;
+        if ((mine & (~mine + 1)) != bit) continue;
+        int ok = 1;
+        for (int i = 0; i < nclauses && ok; ++i) ok = (kind & clauses[i]) != 0;
+        if (!ok) continue;
+        double score = 1.0;
+        if (match) {
+            sqlite3_bind_int(tx, 1, sqlite3_column_int(st, 0));
+            if (sqlite3_step(tx) == SQLITE_ROW) {
+                const char *txt = (const char*)sqlite3_column_text(tx, 0);
+                score = match(txt ? txt : "", (size_t)sqlite3_column_bytes(tx, 0), ctx);
+            } else {
+                score = 0.0;
+            }
+            sqlite3_reset(tx);
+        }
+        if (score <= 0.0) continue;
+        if (order == CHUB_ORDER_FRECENCY) score = sqlite3_column_double(st, 8);
+        if (order != CHUB_ORDER_TS) {
+            if (nhits == caphits) {
+                int cap = caphits ? caphits * 2 : 256;
+                kind_hit *nh = (kind_hit*)realloc(hits, (size_t)cap * sizeof(kind_hit));
+                if (!nh) { rc = 4; break; }
+                hits = nh; caphits = cap;
+            }
+            hits[nhits].id = sqlite3_column_int(st, 0);
+            hits[nhits].ts = (long long)sqlite3_column_int64(st, 1);
+            hits[nhits].score = score;
+            nhits++;
+            continue;
+        }
+        if (push_row(st, rs) != 0) { rc = 4; break; }
+        if (chub_rs_count(rs) == limit) break;
+    }
+    if (step == SQLITE_INTERRUPT) rc = 5;
+    end_budget();
+    sqlite3_finalize(tx);
+    sqlite3_finalize(st);
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0 && rc != 5) { free(hits); chub_rs_free(rs); return rc; }
+
+    if (order != CHUB_ORDER_TS) {
+        chub_rs_free(rs);
+        rs = NULL;
+        qsort(hits, (size_t)nhits, sizeof(kind_hit), cmp_kind_hits);
+        if (nhits > limit) nhits = limit;
+        int *ids = (int*)malloc((size_t)(nhits ? nhits : 1) * sizeof(int));
+        if (!ids) { free(hits); return 4; }
+        for (int i = 0; i < nhits; ++i) ids[i] = hits[i].id;
+        free(hits);
+        int frc = chub_db_fetch_ids(ids, nhits, &rs);
+        free(ids);
+        if (frc != 0) return frc;
+    }
+    *out = rs;
+    return rc;
+}
+
+int chub_db_id_range(long long *out_min, long long *out_max) {
+    if (!G || !out_min || !out_max) return 1;
+    *out_min = 0; *out_max = -1;
+    EnterCriticalSection(&g_cs);
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT min(id), max(id) FROM items", -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); return 2;
+    }
+    if (sqlite3_step(st) == SQLITE_ROW && sqlite3_column_type(st, 0) != SQLITE_NULL) {
+        *out_min = (long long)sqlite3_column_int64(st, 0);
+        *out_max = (long long)sqlite3_column_int64(st, 1);
     }
     sqlite3_finalize(st);
     LeaveCriticalSection(&g_cs);
-    if (n == 0) { free(arr); return 0; }
-    *out_arr = arr; *out_count = n;
     return 0;
 }
 
-void chub_db_free_items(chub_item *arr, int count) {
+int chub_db_fetch_ids(const int *ids, int n, chub_resultset **out) {
+    if (!G || (n > 0 && !ids) || !out) return 1;
+    *out = NULL;
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) return 4;
+    EnterCriticalSection(&g_cs);
+    const char *sql = "SELECT " RS_COLUMNS " FROM items WHERE id=?";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs); chub_rs_free(rs); return 2;
+    }
+    int rc = 0;
+    for (int i = 0; i < n && rc == 0; ++i) {
+        sqlite3_bind_int(st, 1, ids[i]);
+        rc = step_into_rs(st, chub_rs_count(rs) + 1, rs);  /* deleted meanwhile: no row */
+        sqlite3_reset(st);
+    }
+    sqlite3_finalize(st);
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0) { chub_rs_free(rs); return rc; }
+    *out = rs;
+    return 0;
+}
+
+int chub_db_fetch_text(int id, char **out, size_t *out_len) {
+    if (!G || !out) return 1;
+    *out = NULL;
+    size_t len = 0;
+    EnterCriticalSection(&g_cs);
+    int rc = load_text(G, id, 0, out, &len, NULL);
+    LeaveCriticalSection(&g_cs);
+    if (rc == 0 && out_len) *out_len = len;
+    return rc;
+}
+
+int chub_db_get_stats(int sample, chub_db_stats *out) {
+    if (!G || !out) return 1;
+    memset(out, 0, sizeof(*out));
+    EnterCriticalSection(&g_cs);
+    const char *sql =
+        "SELECT count(*), ifnull(sum(i.length),0),"
+        " ifnull(sum(length(CAST(t.text AS BLOB)) + ifnull(length(t.delta),0)),0),"
+        " count(t.base), ifnull(avg(CASE WHEN t.base IS NOT NULL THEN t.depth END),0),"
+        " ifnull(max(t.depth),0) "
+        "FROM items i JOIN item_text t ON t.id=i.id";
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, sql, -1, &st, NULL) != SQLITE_OK) { LeaveCriticalSection(&g_cs); return 2; }
+    int rc = sqlite3_step(st) == SQLITE_ROW ? 0 : 3;
+    if (rc == 0) {
+        out->entries       = (long long)sqlite3_column_int64(st, 0);
+        out->logical_bytes = (long long)sqlite3_column_int64(st, 1);
+        out->stored_bytes  = (long long)sqlite3_column_int64(st, 2);
+        out->deltas        = (long long)sqlite3_column_int64(st, 3);
+        out->avg_depth     = sqlite3_column_double(st, 4);
+        out->max_depth     = sqlite3_column_int(st, 5);
+    }
+    sqlite3_finalize(st);
+    /* time full reconstruction of the newest deltas */
+    if (rc == 0 && sample > 0 &&
+        sqlite3_prepare_v2(G, "SELECT id FROM item_text WHERE base IS NOT NULL ORDER BY id DESC LIMIT ?",
+                           -1, &st, NULL) == SQLITE_OK) {
+        sqlite3_bind_int(st, 1, sample);
+        long long total = 0;
+        while (sqlite3_step(st) == SQLITE_ROW) {
+            char *txt = NULL;
+            size_t len = 0;
+            long long t0 = chub_now_micros();
+            if (load_text(G, sqlite3_column_int64(st, 0), 0, &txt, &len, NULL) != 0) continue;
+            long long dt = chub_now_micros() - t0;
+            free(txt);
+            total += dt;
+            if ((double)dt > out->rebuild_max_us) out->rebuild_max_us = (double)dt;
+            out->sampled++;
+        }
+        sqlite3_finalize(st);
+        if (out->sampled) out->rebuild_avg_us = (double)total / out->sampled;
+    }
+    LeaveCriticalSection(&g_cs);
+    return rc;
+}
+
+/* ----- sync (chub/sync.h) ----- */
+
+/* the history so far, for the first segment: one insert per content hash
+   (oldest first) and the favorites */
+static const char *const SYNC_SEED_SQL[] = {
+    "INSERT INTO changes(hlc,op,arg,hash,ts,kind)"
+    " SELECT ?1,1,0,hash,max(ts),kind FROM items GROUP BY hash ORDER BY max(ts)",
+    "INSERT INTO changes(hlc,op,arg,hash,ts,kind)"
+    " SELECT ?1,2,1,hash,max(ts),kind FROM items WHERE favorite=1 GROUP BY hash",
+    "INSERT INTO sync_keys(hash,fav,fav_hlc)"
+    " SELECT hash,1,?1 FROM items WHERE favorite=1 GROUP BY hash ON CONFLICT(hash) DO NOTHING",
+};
+
+static int seed_sync(const char *node) {
+    sqlite3_stmt *st = NULL;
+    long long hlc = hlc_tick(0);
+    if (sqlite3_prepare_v2(G, "INSERT INTO sync_node(id,node,hlc) VALUES(1,?,?)", -1, &st, NULL) != SQLITE_OK)
+        return 2;
+    sqlite3_bind_text (st, 1, node, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(st, 2, hlc);
+    int rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
+    sqlite3_finalize(st);
+    for (size_t i = 0; rc == 0 && i < sizeof(SYNC_SEED_SQL) / sizeof(SYNC_SEED_SQL[0]); ++i) {
+        if (sqlite3_prepare_v2(G, SYNC_SEED_SQL[i], -1, &st, NULL) != SQLITE_OK) return 2;
+        sqlite3_bind_int64(st, 1, hlc);
+        rc = sqlite3_step(st) == SQLITE_DONE ? 0 : 3;
+        sqlite3_finalize(st);
+    }
+    return rc;
+}
+
+int chub_db_sync_enable(char node[CHUB_SYNC_NODE_LEN + 1], long long *exported) {
+    if (!G || !node || !exported) return 1;
+    if (g_sealed) return 7;
+    EnterCriticalSection(&g_cs);
+    sqlite3_stmt *st = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT node,exported FROM sync_node WHERE id=1", -1, &st, NULL) != SQLITE_OK) {
+        LeaveCriticalSection(&g_cs);
+        return 2;
+    }
+    int rc = 0;
+    if (sqlite3_step(st) == SQLITE_ROW) {
+        snprintf(node, CHUB_SYNC_NODE_LEN + 1, "%s", (const char*)sqlite3_column_text(st, 0));
+        *exported = sqlite3_column_int64(st, 1);
+        sqlite3_finalize(st);
+        LeaveCriticalSection(&g_cs);
+        return 0;
+    }
+    sqlite3_finalize(st);
+    unsigned char id[CHUB_SYNC_NODE_LEN / 2];
+    if (chub_crypt_random(id, sizeof(id)) != 0) rc = 3;
+    for (size_t i = 0; rc == 0 && i < sizeof(id); ++i) snprintf(node + 2 * i, 3, "%02x", id[i]);
+    if (rc == 0 && exec_sql("BEGIN IMMEDIATE;") != SQLITE_OK) rc = 3;
+    if (rc == 0) {
+        rc = seed_sync(node);
+        exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
+    }
+    if (rc == 0) {
+        g_sync = 1;
+        *exported = 0;
+    }
+    LeaveCriticalSection(&g_cs);
+    return rc;
+}
+
+int chub_db_changes_since(long long seq, int limit, chub_change **out, int *out_count) {
+    if (!G || !out || !out_count || limit <= 0) return 1;
+    *out = NULL;
+    *out_count = 0;
+    chub_change *arr = (chub_change*)calloc((size_t)limit, sizeof(chub_change));
+    if (!arr) return 4;
+    EnterCriticalSection(&g_cs);
+    sqlite3_stmt *st = NULL, *lk = NULL;
+    if (sqlite3_prepare_v2(G, "SELECT seq,hlc,op,arg,hash,ts,kind FROM changes WHERE seq>? ORDER BY seq LIMIT ?",
+                           -1, &st, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(G, "SELECT id FROM items WHERE hash=? ORDER BY ts DESC LIMIT 1",
+                           -1, &lk, NULL) != SQLITE_OK) {
+        sqlite3_finalize(st);
+        LeaveCriticalSection(&g_cs);
+        free(arr);
+        return 2;
+    }
+    sqlite3_bind_int64(st, 1, seq);
+    sqlite3_bind_int  (st, 2, limit);
+    int n = 0, rc = SQLITE_DONE;
+    while (n < limit && (rc = sqlite3_step(st)) == SQLITE_ROW) {
+        chub_change *c = &arr[n++];
+        c->seq  = sqlite3_column_int64(st, 0);
+        c->hlc  = sqlite3_column_int64(st, 1);
+        c->op   = sqlite3_column_int(st, 2);
+        c->arg  = sqlite3_column_int(st, 3);
+        c->h    = (unsigned long long)sqlite3_column_int64(st, 4);
+        c->ts   = sqlite3_column_int64(st, 5);
+        c->kind = (unsigned)sqlite3_column_int(st, 6);
+        if (c->op != CHUB_CHANGE_INSERT) continue;
+        /* text is read at export; NULL if the entry is gone by now */
+        sqlite3_reset(lk);
+        sqlite3_bind_int64(lk, 1, (sqlite3_int64)c->h);
+        if (sqlite3_step(lk) == SQLITE_ROW &&
+            load_text(G, sqlite3_column_int64(lk, 0), 0, &c->text, &c->len, NULL) != 0)
+            c->text = NULL;
+    }
+    rc = (n == limit || rc == SQLITE_DONE) ? 0 : 3;
+    sqlite3_finalize(st);
+    sqlite3_finalize(lk);
+    LeaveCriticalSection(&g_cs);
+    if (rc != 0) { chub_db_free_changes(arr, n); return rc; }
+    *out = arr;
+    *out_count = n;
+    return 0;
+}
+
+void chub_db_free_changes(chub_change *arr, int count) {
     if (!arr) return;
     for (int i = 0; i < count; ++i) free(arr[i].text);
     free(arr);
 }
+
+int chub_db_changes_exported(long long seq) {
+    if (!G) return 1;
+    EnterCriticalSection(&g_cs);
+    sqlite3_stmt *st = NULL, *del = NULL;
+    if (sqlite3_prepare_v2(G, "UPDATE sync_node SET exported=max(exported,?), hlc=? WHERE id=1",
+                           -1, &st, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(G, "DELETE FROM changes WHERE seq<=?", -1, &del, NULL) != SQLITE_OK) {
+        sqlite3_finalize(st);
+        LeaveCriticalSection(&g_cs);
+        return 2;
+    }
+    sqlite3_bind_int64(st, 1, seq);
+    sqlite3_bind_int64(st, 2, g_hlc);
+    sqlite3_bind_int64(del, 1, seq);
+    exec_sql("BEGIN;");
+    int rc = sqlite3_step(st) == SQLITE_DONE && sqlite3_step(del) == SQLITE_DONE ? 0 : 3;
+    exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
+    sqlite3_finalize(st);
+    sqlite3_finalize(del);
+    LeaveCriticalSection(&g_cs);
+    return rc;
+}
+
+static long long peer_seq_locked(const char *node) {
+    sqlite3_stmt *st = NULL;
+    long long seq = 0;
+    if (sqlite3_prepare_v2(G, "SELECT seq FROM sync_peers WHERE node=?", -1, &st, NULL) != SQLITE_OK) return 0;
+    sqlite3_bind_text(st, 1, node, -1, SQLITE_STATIC);
+    if (sqlite3_step(st) == SQLITE_ROW) seq = sqlite3_column_int64(st, 0);
+    sqlite3_finalize(st);
+    return seq;
+}
+
+long long chub_db_peer_seq(const char *node) {
+    if (!G || !node) return 0;
+    EnterCriticalSection(&g_cs);
+    long long seq = peer_seq_locked(node);
+    LeaveCriticalSection(&g_cs);
+    return seq;
+}
+
+enum { AP_KEYS, AP_EXISTS, AP_MOVE, AP_FAV, AP_FAV_KEY, AP_DEL, AP_DEL_KEY, AP_PEER, AP_NODE, AP_COUNT };
+
+static const char *const APPLY_SQL[AP_COUNT] = {
+    "SELECT fav,fav_hlc,del_hlc FROM sync_keys WHERE hash=?1",
+    "SELECT 1 FROM items WHERE hash=?1 LIMIT 1",
+    "UPDATE items SET ts=?2 WHERE id=(SELECT id FROM items WHERE hash=?1 ORDER BY ts DESC LIMIT 1) AND ts<?2",
+    "UPDATE items SET favorite=?2 WHERE hash=?1 AND favorite<>?2",
+    "INSERT INTO sync_keys(hash,fav,fav_hlc) VALUES(?1,?2,?3)"
+    " ON CONFLICT(hash) DO UPDATE SET fav=excluded.fav, fav_hlc=excluded.fav_hlc",
+    "DELETE FROM items WHERE hash=?1 AND ts<=?2",
+    "INSERT INTO sync_keys(hash,del_hlc) VALUES(?1,?2)"
+    " ON CONFLICT(hash) DO UPDATE SET del_hlc=excluded.del_hlc",
+    "INSERT INTO sync_peers(node,seq) VALUES(?1,?2) ON CONFLICT(node) DO UPDATE SET seq=max(seq,excluded.seq)",
+    "UPDATE sync_node SET hlc=?1 WHERE id=1",
+};
+
+static int step_done(sqlite3_stmt *st) {
+    int rc = sqlite3_step(st);
+    sqlite3_reset(st);
+    return rc == SQLITE_DONE;
+}
+
+/* one peer change under last-writer-wins per content hash: 1 if it
+   changed something, 0 if it lost or was already in, -1 on error */
+static int apply_change(sqlite3_stmt **ap, const chub_change *c) {
+    unsigned long long h = c->h;
+    if (c->op == CHUB_CHANGE_INSERT) {
+        if (!c->text) return 0;
+        h = chub_hash64(c->text);  /* recomputed: the key is what dedups */
+    }
+    int fav = 0;
+    long long fav_hlc = 0, del_hlc = 0;
+    sqlite3_stmt *st = ap[AP_KEYS];
+    sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+    if (sqlite3_step(st) == SQLITE_ROW) {
+        fav = sqlite3_column_int(st, 0);
+        fav_hlc = sqlite3_column_int64(st, 1);
+        del_hlc = sqlite3_column_int64(st, 2);
+    }
+    sqlite3_reset(st);
+
+    switch (c->op) {
+    case CHUB_CHANGE_INSERT: {
+        if (del_hlc >= c->hlc) return 0;  /* deleted after it was captured */
+        st = ap[AP_EXISTS];
+        sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+        int exists = sqlite3_step(st) == SQLITE_ROW;
+        sqlite3_reset(st);
+        if (exists) {
+            /* the same content: keep one entry at the later time */
+            st = ap[AP_MOVE];
+            sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+            sqlite3_bind_int64(st, 2, c->ts);
+            if (!step_done(st)) return -1;
+            return sqlite3_changes(G) > 0;
+        }
+        if (insert_locked(c->text, h, c->ts, c->kind, NULL) != 0) return -1;
+        if (fav_hlc && fav) {
+            st = ap[AP_FAV];
+            sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+            sqlite3_bind_int  (st, 2, 1);
+            if (!step_done(st)) return -1;
+        }
+        return 1;
+    }
+    case CHUB_CHANGE_FAVORITE:
+        if (fav_hlc >= c->hlc) return 0;
+        st = ap[AP_FAV_KEY];
+        sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+        sqlite3_bind_int  (st, 2, c->arg ? 1 : 0);
+        sqlite3_bind_int64(st, 3, c->hlc);
+        if (!step_done(st)) return -1;
+        st = ap[AP_FAV];
+        sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+        sqlite3_bind_int  (st, 2, c->arg ? 1 : 0);
+        if (!step_done(st)) return -1;
+        return sqlite3_changes(G) > 0;
+    case CHUB_CHANGE_DELETE:
+    case CHUB_CHANGE_PRUNE:
+        if (del_hlc >= c->hlc) return 0;
+        st = ap[AP_DEL_KEY];
+        sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+        sqlite3_bind_int64(st, 2, c->hlc);
+        if (!step_done(st)) return -1;
+        /* captures up to the one deleted there (its ts, so clock skew
+           between the machines doesn't matter); a later re-capture stays */
+        st = ap[AP_DEL];
+        sqlite3_bind_int64(st, 1, (sqlite3_int64)h);
+        sqlite3_bind_int64(st, 2, c->ts);
+        if (!step_done(st)) return -1;
+        return sqlite3_changes(G) > 0;
+    }
+    return 0;
+}
+
+int chub_db_apply_changes(const char *node, const chub_change *arr, int count,
+                          long long through, int *applied) {
+    if (!G || !node || (!arr && count)) return 1;
+    if (applied) *applied = 0;
+    EnterCriticalSection(&g_cs);
+    if (!g_sync) { LeaveCriticalSection(&g_cs); return 1; }
+    sqlite3_stmt *ap[AP_COUNT] = { NULL };
+    int rc = 0;
+    for (int i = 0; rc == 0 && i < AP_COUNT; ++i)
+        if (sqlite3_prepare_v2(G, APPLY_SQL[i], -1, &ap[i], NULL) != SQLITE_OK) rc = 2;
+    long long done = peer_seq_locked(node), last = done;
+    int n = 0;
+    if (rc == 0 && exec_sql("BEGIN IMMEDIATE;") != SQLITE_OK) rc = 3;
+    for (int i = 0; rc == 0 && i < count; ++i) {
+        if (arr[i].seq <= done) continue;  /* merged on an earlier run */
+        hlc_tick(arr[i].hlc);
+        int r = apply_change(ap, &arr[i]);
+        if (r < 0) rc = 3;
+        else n += r;
+        if (arr[i].seq > last) last = arr[i].seq;
+    }
+    if (through > last) last = through;
+    if (rc == 0 && last > done) {
+        sqlite3_bind_text (ap[AP_PEER], 1, node, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(ap[AP_PEER], 2, last);
+        sqlite3_bind_int64(ap[AP_NODE], 1, g_hlc);
+        if (!step_done(ap[AP_PEER]) || !step_done(ap[AP_NODE])) rc = 3;
+    }
+    if (rc != 2) exec_sql(rc == 0 ? "COMMIT;" : "ROLLBACK;");
+    for (int i = 0; i < AP_COUNT; ++i) sqlite3_finalize(ap[i]);
+    LeaveCriticalSection(&g_cs);
+    if (rc == 0 && applied) *applied = n;
+    return rc;
+}
+
@@ -0,0 +1,265 @@
+#include "chub/delta.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SHINGLE     8
+#define BLK         16           /* delta match granularity */
+#define ROLL_MUL    0x01000193u
+#define DELTA_MAGIC 'D'
+
+#define LSH_BANDS   4
+#define LSH_BUCKETS 1024         /* per band; band values are folded into this */
+
+/* ----- SimHash ----- */
+
+static unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+unsigned long long chub_simhash(const char *s, size_t len) {
+    int counts[64];
+    memset(counts, 0, sizeof(counts));
+    const unsigned char *p = (const unsigned char*)s;
+    size_t k = len < SHINGLE ? len : SHINGLE;
+    /* long texts keep a content-defined quarter of the shingles */
+    unsigned long long sample = len > 4096 ? 3 : 0;
+    for (size_t i = 0; i + k <= len; ++i) {
+        unsigned long long h = 1469598103934665603ULL;
+        for (size_t j = 0; j < k; ++j) { h ^= p[i + j]; h *= 1099511628211ULL; }
+        h = mix64(h);
+        if (h & sample) continue;
+        for (int b = 0; b < 64; ++b) counts[b] += (int)((h >> b) & 1) * 2 - 1;
+    }
+    unsigned long long out = 0;
+    for (int b = 0; b < 64; ++b) if (counts[b] > 0) out |= 1ULL << b;
+    return out;
+}
+
+int chub_simhash_distance(unsigned long long a, unsigned long long b) {
+    unsigned long long x = a ^ b;
+    int n = 0;
+    for (; x; x &= x - 1) ++n;
+    return n;
+}
+
+/* ----- LSH ----- */
+
+typedef struct {
+    int id;
+    int depth;
+    unsigned long long sketch;
+    int next[LSH_BANDS];
+} lsh_entry;
+
+static lsh_entry g_ring[CHUB_LSH_ENTRIES];
+static int g_head[LSH_BANDS][LSH_BUCKETS];
+static int g_used = 0, g_pos = 0, g_inited = 0;
+
+static unsigned band_of(unsigned long long sk, int b) {
+    return (unsigned)((sk >> (16 * b)) & 0xFFFF);
+}
+
+static unsigned bucket_of(unsigned band) {
+    return (band * 40503u >> 6) & (LSH_BUCKETS - 1);
+}
+
+void chub_lsh_reset(void) {
+    for (int b = 0; b < LSH_BANDS; ++b)
+        for (int i = 0; i < LSH_BUCKETS; ++i) g_head[b][i] = -1;
+    g_used = 0; g_pos = 0; g_inited = 1;
+}
+
+static void unlink_slot(int slot) {
+    for (int b = 0; b < LSH_BANDS; ++b) {
+        int *link = &g_head[b][bucket_of(band_of(g_ring[slot].sketch, b))];
+        while (*link >= 0 && *link != slot) link = &g_ring[*link].next[b];
+        if (*link == slot) *link = g_ring[slot].next[b];
+    }
+}
+
+void chub_lsh_add(int id, unsigned long long sketch, int depth) {
+    if (!g_inited) chub_lsh_reset();
+    int slot = g_pos;
+    if (g_used == CHUB_LSH_ENTRIES) unlink_slot(slot);
+    else g_used++;
+    g_pos = (g_pos + 1) % CHUB_LSH_ENTRIES;
+    lsh_entry *e = &g_ring[slot];
+    e->id = id;
+    e->depth = depth;
+    e->sketch = sketch;
+    for (int b = 0; b < LSH_BANDS; ++b) {
+        int *head = &g_head[b][bucket_of(band_of(sketch, b))];
+        e->next[b] = *head;
+        *head = slot;
+    }
+}
+
+int chub_lsh_query(unsigned long long sketch, int max_dist, int max_depth,
+                   int *ids, int max_ids) {
+    if (!g_inited || max_ids <= 0) return 0;
+    int slots[CHUB_LSH_ENTRIES], dists[CHUB_LSH_ENTRIES];
+    int n = 0;
+    for (int b = 0; b < LSH_BANDS; ++b) {
+        unsigned band = band_of(sketch, b);
+        for (int s = g_head[b][bucket_of(band)]; s >= 0; s = g_ring[s].next[b]) {
+            const lsh_entry *e = &g_ring[s];
+            if (band_of(e->sketch, b) != band || e->depth >= max_depth) continue;
+            int d = chub_simhash_distance(sketch, e->sketch);
+            if (d > max_dist) continue;
+            int dup = 0;
+            for (int k = 0; k < n && !dup; ++k) dup = slots[k] == s;
+            if (dup) continue;
+            /* insertion sort: closest first, newest first among equals */
+            int k = n++;
+            while (k > 0 && dists[k - 1] > d) { slots[k] = slots[k - 1]; dists[k] = dists[k - 1]; --k; }
+            slots[k] = s; dists[k] = d;
+        }
+    }
+    if (n > max_ids) n = max_ids;
+    for (int k = 0; k < n; ++k) ids[k] = g_ring[slots[k]].id;
+    return n;
+}
+
+/* ----- delta codec -----
+   'D', varint target length, then ops:
+     varint (n << 1)      followed by n literal bytes   (ADD)
+     varint (n << 1 | 1), varint base offset             (COPY) */
+
+typedef struct {
+    unsigned char *p;
+    size_t len, cap;
+} buf;
+
+static int buf_reserve(buf *b, size_t extra) {
+    if (b->cap - b->len >= extra) return 0;
+    size_t ncap = b->cap ? b->cap : 64;
+    while (ncap - b->len < extra) ncap *= 2;
+    unsigned char *np = (unsigned char*)realloc(b->p, ncap);
+    if (!np) return 1;
+    b->p = np; b->cap = ncap;
+    return 0;
+}
+
+static int put_varint(buf *b, unsigned long long v) {
+    if (buf_reserve(b, 10)) return 1;
+    do {
+        unsigned char c = (unsigned char)(v & 0x7F);
+        v >>= 7;
+        b->p[b->len++] = (unsigned char)(c | (v ? 0x80 : 0));
+    } while (v);
+    return 0;
+}
+
+static int put_add(buf *b, const char *s, size_t n) {
+    if (!n) return 0;
+    if (put_varint(b, (unsigned long long)n << 1) || buf_reserve(b, n)) return 1;
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+    return 0;
+}
+
+static int put_copy(buf *b, size_t off, size_t n) {
+    return put_varint(b, (unsigned long long)n << 1 | 1) || put_varint(b, off);
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, unsigned long long *v) {
+    unsigned long long r = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p >= end) return 1;
+        unsigned char c = *(*p)++;
+        r |= (unsigned long long)(c & 0x7F) << shift;
+        if (!(c & 0x80)) { *v = r; return 0; }
+    }
+    return 1;
+}
+
+static unsigned block_hash(const unsigned char *p) {
+    unsigned h = 0;
+    for (int i = 0; i < BLK; ++i) h = h * ROLL_MUL + p[i];
+    return h;
+}
+
+int chub_delta_encode(const char *base, size_t base_len,
+                      const char *target, size_t target_len,
+                      unsigned char **out, size_t *out_len) {
+    if (!out || !out_len || (!base && base_len) || (!target && target_len)) return 1;
+    *out = NULL; *out_len = 0;
+    const unsigned char *B = (const unsigned char*)base, *T = (const unsigned char*)target;
+
+    /* index the base at block-aligned offsets */
+    size_t nblocks = base_len / BLK;
+    size_t tsize = 64;
+    while (tsize < nblocks * 2) tsize *= 2;
+    unsigned *table = (unsigned*)calloc(tsize, sizeof(unsigned));  /* offset + 1; 0 = empty */
+    if (!table) return 4;
+    for (size_t k = 0; k < nblocks; ++k) {
+        unsigned *slot = &table[block_hash(B + k * BLK) & (tsize - 1)];
+        if (!*slot) *slot = (unsigned)(k * BLK + 1);
+    }
+
+    unsigned pow = 1;  /* ROLL_MUL^(BLK-1) */
+    for (int i = 1; i < BLK; ++i) pow *= ROLL_MUL;
+
+    buf b = { NULL, 0, 0 };
+    int err = buf_reserve(&b, 16);
+    if (!err) { b.p[b.len++] = DELTA_MAGIC; err = put_varint(&b, target_len); }
+    size_t i = 0, lit = 0;
+    unsigned h = target_len >= BLK ? block_hash(T) : 0;
+    while (!err && nblocks && i + BLK <= target_len) {
+        unsigned cand = table[h & (tsize - 1)];
+        if (cand && memcmp(B + cand - 1, T + i, BLK) == 0) {
+            size_t off = cand - 1, n = BLK;
+            while (i > lit && off > 0 && B[off - 1] == T[i - 1]) { --i; --off; ++n; }
+            while (off + n < base_len && i + n < target_len && B[off + n] == T[i + n]) ++n;
+            err = put_add(&b, target + lit, i - lit) || put_copy(&b, off, n);
+            i += n;
+            lit = i;
+            if (i + BLK <= target_len) h = block_hash(T + i);
+            continue;
+        }
+        if (i + BLK >= target_len) break;
+        h = (h - T[i] * pow) * ROLL_MUL + T[i + BLK];
+        ++i;
+    }
+    if (!err) err = put_add(&b, target + lit, target_len - lit);
+    free(table);
+    if (err) { free(b.p); return 4; }
+    *out = b.p;
+    *out_len = b.len;
+    return 0;
+}
+
+int chub_delta_apply(const char *base, size_t base_len,
+                     const unsigned char *delta, size_t delta_len,
+                     char **out, size_t *out_len) {
+    if (!out || !delta) return 1;
+    *out = NULL;
+    const unsigned char *p = delta, *end = delta + delta_len;
+    unsigned long long tlen;
+    if (p >= end || *p++ != DELTA_MAGIC || get_varint(&p, end, &tlen) || tlen > (1ULL << 31)) return 2;
+    char *t = (char*)malloc((size_t)tlen + 1);
+    if (!t) return 4;
+    size_t w = 0;
+    while (p < end) {
+        unsigned long long op, n, off;
+        if (get_varint(&p, end, &op)) break;
+        n = op >> 1;
+        if (n > tlen - w) break;
+        if (op & 1) {
+            if (get_varint(&p, end, &off) || off > base_len || n > base_len - off) break;
+            memcpy(t + w, base + off, (size_t)n);
+        } else {
+            if (n > (unsigned long long)(end - p)) break;
+            memcpy(t + w, p, (size_t)n);
+            p += n;
+        }
+        w += (size_t)n;
+    }
+    if (p != end || w != tlen) { free(t); return 2; }
+    t[w] = '\0';
+    *out = t;
+    if (out_len) *out_len = w;
+    return 0;
+}
@@ -1,6 +1,12 @@
 #include "chub/tui.h"
 #include "chub/db.h"
+#include "chub/classify.h"
 #include "chub/clip.h"
+#include "chub/crypt.h"
+#include "chub/scan.h"
+#include "chub/secret.h"
+#include "chub/snapshot.h"
+#include "chub/sync.h"
 #include "chub/util.h"
 
 #include <stdio.h>
@@ -16,6 +22,15 @@ static volatile LONG g_stop = 0;
 static int g_retention = 500;
 static int g_interval_ms = 500;
 static char g_db_path[MAX_PATH * 4];
+static char g_snap_path[MAX_PATH * 4];
+static volatile LONG g_db_failed = 0;
+static const char *g_secret_rules = NULL;
+static int g_snapshots = 1;  /* off when previews are encrypted: the snapshot is plaintext */
+
+#define SNAPSHOT_MIN_INTERVAL_MS 10000
+#define MAINTAIN_INTERVAL_MS     (10 * 60 * 1000)
+#define STATS_REBUILD_SAMPLE     200
+#define CAPTURE_DROPPED          (-1)
 
 typedef struct {
     unsigned long long last_h;
@@ -64,33 +79,210 @@ static void notify_tui_refresh(void) {
     chub__tui__request_refresh__export();
 }
 
+static void write_snapshot(void) {
+    if (!g_snapshots) return;
+    chub_resultset *rs = NULL;
+    if (chub_db_fetch_recent_rs(CHUB_SNAPSHOT_ITEMS, &rs) != 0) return;
+    chub_snapshot_write(g_snap_path, rs);
+    chub_rs_free(rs);
+}
+
+/* 0 when the capture was stored or merged into an existing entry,
+   CAPTURE_DROPPED when it held a secret that couldn't be redacted */
+static int store_capture(char *buf, size_t buf_sz, unsigned long long h, int redact) {
+    if (redact) {
+        if (chub_secret_redact(buf, buf_sz) != 0) {
+            chub_log("WARN", "dropping a capture that couldn't be redacted");
+            return CAPTURE_DROPPED;  /* never store it partially redacted */
+        }
+        h = chub_hash64(buf);
+    }
+    long long ts = chub_now_millis();
+    /* our own copy-back: bump the entry rather than duplicate it */
+    if (chub_clip_is_self_write(h) && chub_db_touch(h, ts) == 0) return 0;
+    return chub_db_insert(buf, h, ts, chub_classify(buf, strlen(buf)));
+}
+
 static unsigned __stdcall poller_thread(void *arg) {
     (void)arg;
+    /* the TUI is already painting from the snapshot while this runs */
+    if (chub_db_open(g_db_path) != 0) {
+        InterlockedExchange(&g_db_failed, 1);
+        chub_tui_request_quit();
+        return 1;
+    }
+    chub_scan_start(0);  /* optional: searches fall back to one connection */
+    notify_tui_refresh();
+
     poll_state st = {0, 0};
     char buf[64 * 1024];
+    int snap_dirty = 0;
+    long long snap_last = chub_now_millis();
+    long long maint_last = snap_last;
     while (!InterlockedCompareExchange(&g_stop, 0, 0)) {
         buf[0] = '\0';
         if (chub_clip_read(buf, sizeof(buf)) == 0) {
             normalize_newlines(buf);
             if (!is_only_whitespace(buf)) {
-                unsigned long long h = chub_hash64(buf);
+                /* hash and secret scan in one pass; dedup keys on the raw text */
+                chub_secret_result sr;
+                chub_secret_scan(buf, strlen(buf), &sr);
+                unsigned long long h = sr.h;
                 if (!st.initialized || h != st.last_h) {
-                    long long ts = chub_now_millis();
-                    if (chub_db_insert(buf, h, ts) == 0) {
+                    if (sr.rule_mask) chub_secret_record(&sr);
+                    int rc = sr.drop ? CAPTURE_DROPPED : store_capture(buf, sizeof(buf), h, sr.hits > 0);
+                    if (rc == CAPTURE_DROPPED) {
+                        st.last_h = h; st.initialized = 1;  /* don't rescan it every tick */
+                    } else if (rc == 0) {
                         chub_db_prune(g_retention);
                         notify_tui_refresh();
                         st.last_h = h; st.initialized = 1;
+                        snap_dirty = 1;
                     }
                 }
             }
         }
+        if (snap_dirty && chub_now_millis() - snap_last >= SNAPSHOT_MIN_INTERVAL_MS) {
+            write_snapshot();
+            snap_dirty = 0;
+            snap_last = chub_now_millis();
+        }
+        if (chub_now_millis() - maint_last >= MAINTAIN_INTERVAL_MS) {
+            chub_db_maintain();
+            maint_last = chub_now_millis();
+        }
         Sleep((DWORD)g_interval_ms);
     }
     return 0;
 }
 
 static void usage(const char *exe) {
-    printf("Usage: %s [--version] [--db PATH] [--retention N] [--interval MS]\n", exe);
+    printf("Usage: %s [sync DIR] [--version] [--db PATH] [--retention N] [--interval MS]\n"
+           "       [--secrets off|drop|redact] [--secret-rules FILE]\n"
+           "       [--mmap-mb N] [--cache-kb N] [--temp-store default|file|memory]\n"
+           "       [--key-file PATH] [--plain-previews]\n"
+           "       [--stats] [--bench-crypto]\n"
+           "Set CHUB_PASSPHRASE (or pass --key-file) to encrypt the history.\n"
+           "sync DIR exchanges new history with other instances through a shared folder.\n", exe);
+}
+
+static double bench_mbps(size_t bytes, long long us) {
+    return us > 0 ? (double)bytes / (double)us : 0.0;  /* bytes/us == MB/s */
+}
+
+/* --bench-crypto: seal/open throughput against a plaintext copy, which is
+   what the unencrypted path does with the same buffer */
+static int bench_crypto(void) {
+    unsigned char key[CHUB_CRYPT_KEY_BYTES], salt[CHUB_CRYPT_SALT_BYTES];
+    if (chub_crypt_random(key, sizeof(key)) != 0 || chub_crypt_random(salt, sizeof(salt)) != 0 ||
+        chub_crypt_set_key(key) != 0) {
+        chub_log("ERR", "CNG AES-GCM unavailable");
+        return 1;
+    }
+    long long t0 = chub_now_micros();
+    chub_crypt_derive("benchmark passphrase", salt, sizeof(salt), CHUB_CRYPT_KDF_ITERS, key);
+    printf("kdf              PBKDF2-SHA256 x%d: %.1f ms (once per start)\n",
+           CHUB_CRYPT_KDF_ITERS, (double)(chub_now_micros() - t0) / 1000.0);
+
+    static const size_t sizes[] = { 512, 4 * 1024, 64 * 1024 };
+    const size_t total = 64u * 1024 * 1024;
+    char *plain = (char*)malloc(sizes[2]);
+    if (!plain) return 1;
+    for (size_t i = 0; i < sizes[2]; ++i) plain[i] = (char)('a' + i % 26);
+    printf("%-8s %12s %12s %12s %14s\n", "size", "copy MB/s", "seal MB/s", "open MB/s", "seal us/entry");
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k) {
+        size_t n = sizes[k], iters = total / n;
+        unsigned char *sealed = NULL;
+        size_t slen = 0;
+        char *back = NULL;
+        int rc = 0;
+        long long a = chub_now_micros();
+        for (size_t it = 0; it < iters; ++it) {
+            char *c = (char*)malloc(n);
+            if (c) { memcpy(c, plain, n); plain[0] ^= c[n - 1] & 1; }  /* keep the copy live */
+            free(c);
+        }
+        long long b = chub_now_micros();
+        for (size_t it = 0; it < iters && rc == 0; ++it) {
+            free(sealed);
+            rc = chub_crypt_seal((long long)it, plain, n, &sealed, &slen);
+        }
+        long long c = chub_now_micros();
+        for (size_t it = 0; it < iters && rc == 0; ++it) {
+            free(back);
+            rc = chub_crypt_open((long long)iters - 1, sealed, slen, &back, NULL);
+        }
+        long long d = chub_now_micros();
+        free(sealed);
+        free(back);
+        if (rc != 0) { free(plain); return 1; }
+        long long t_copy = b - a, t_seal = c - b, t_open = d - c;
+        printf("%-8u %12.0f %12.0f %12.0f %14.2f\n", (unsigned)n,
+               bench_mbps(total, t_copy), bench_mbps(total, t_seal), bench_mbps(total, t_open),
+               (double)t_seal / (double)iters);
+    }
+    free(plain);
+    chub_crypt_clear();
+    return 0;
+}
+
+/* --stats: storage report, then exit without starting the UI */
+static int print_stats(void) {
+    if (chub_db_open(g_db_path) != 0) {
+        chub_log("ERR", "Failed to open DB at %s", g_db_path);
+        return 1;
+    }
+    chub_db_stats s;
+    int rc = chub_db_get_stats(STATS_REBUILD_SAMPLE, &s);
+    chub_db_close();
+    if (rc != 0) return 1;
+    double saved = s.logical_bytes > 0
+        ? 100.0 * (double)(s.logical_bytes - s.stored_bytes) / (double)s.logical_bytes : 0.0;
+    printf("entries          %lld\n", s.entries);
+    printf("text bytes       %lld logical, %lld stored (%.1f%% saved)\n",
+           s.logical_bytes, s.stored_bytes, saved);
+    printf("deltas           %lld (avg depth %.2f, max %d)\n", s.deltas, s.avg_depth, s.max_depth);
+    if (s.sampled)
+        printf("rebuild latency  avg %.1f us, max %.1f us over %d deltas\n",
+               s.rebuild_avg_us, s.rebuild_max_us, s.sampled);
+    return 0;
+}
+
+/* sync DIR: one exchange of change-log segments, then exit */
+static int run_sync(const char *dir) {
+    if (chub_db_open(g_db_path) != 0) {
+        chub_log("ERR", "Failed to open DB at %s", g_db_path);
+        return 1;
+    }
+    long long t0 = chub_now_micros();
+    chub_sync_report r;
+    int rc = chub_sync_run(dir, &r);
+    if (rc == 0 && r.applied) write_snapshot();  /* the next start paints the merged history */
+    chub_db_close();
+    if (rc == 7) {
+        chub_log("ERR", "sync is not available for encrypted databases (segments would hold plaintext)");
+        return 1;
+    }
+    if (rc != 0) {
+        chub_log("ERR", "sync with %s failed (%d)", dir, rc);
+        return 1;
+    }
+    printf("instance         %s\n", r.node);
+    printf("exported         %d change(s) in %d segment(s)\n", r.exported, r.segments_written);
+    printf("merged           %d of %d change(s) from %d segment(s), %d peer(s)\n",
+           r.applied, r.changes_read, r.segments_read, r.peers);
+    if (r.compacted)
+        printf("compacted        %d segments into one, %d superseded change(s) dropped\n",
+               r.compacted, r.dropped);
+    printf("took             %.1f ms\n", (double)(chub_now_micros() - t0) / 1000.0);
+    return 0;
+}
+
+static void log_secret_hits(void) {
+    for (int i = 0; i < chub_secret_rule_count(); ++i) {
+        long n = chub_secret_rule_hits(i);
+        if (n > 0) chub_log("INFO", "secret rule %s: %ld hit(s)", chub_secret_rule_name(i), n);
+    }
 }
 
 int main(int argc, char **argv) {
@@ -100,6 +292,10 @@ int main(int argc, char **argv) {
     }
 
     compute_default_db_path(g_db_path, sizeof(g_db_path));
+    chub_db_config dbcfg = CHUB_DB_CONFIG_DEFAULT;
+    int stats = 0;
+    const char *sync_dir = NULL;
+    chub_db_crypt_config crypt = { getenv("CHUB_PASSPHRASE"), NULL, 0 };
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--db") == 0 && i+1 < argc) {
@@ -109,28 +305,80 @@ int main(int argc, char **argv) {
             g_retention = atoi(argv[++i]); if (g_retention <= 0) g_retention = 500;
         } else if (strcmp(argv[i], "--interval") == 0 && i+1 < argc) {
             g_interval_ms = atoi(argv[++i]); if (g_interval_ms < 100) g_interval_ms = 100;
+        } else if (strcmp(argv[i], "--mmap-mb") == 0 && i+1 < argc) {
+            int mb = atoi(argv[++i]); if (mb < 0) mb = 0;
+            dbcfg.mmap_size = (long long)mb * 1024 * 1024;
+        } else if (strcmp(argv[i], "--cache-kb") == 0 && i+1 < argc) {
+            dbcfg.cache_kib = atoi(argv[++i]); if (dbcfg.cache_kib < 64) dbcfg.cache_kib = 64;
+        } else if (strcmp(argv[i], "--temp-store") == 0 && i+1 < argc) {
+            const char *a = argv[++i];
+            dbcfg.temp_store = strcmp(a, "file") == 0 ? 1 : strcmp(a, "memory") == 0 ? 2 : 0;
+        } else if (strcmp(argv[i], "--secrets") == 0 && i+1 < argc) {
+            const char *a = argv[++i];
+            if (strcmp(a, "off") == 0) chub_secret_set_action(CHUB_SECRET_OFF);
+            else if (strcmp(a, "drop") == 0) chub_secret_set_action(CHUB_SECRET_DROP);
+            else chub_secret_set_action(CHUB_SECRET_REDACT);
+        } else if (strcmp(argv[i], "--secret-rules") == 0 && i+1 < argc) {
+            g_secret_rules = argv[++i];
+        } else if (strcmp(argv[i], "--key-file") == 0 && i+1 < argc) {
+            crypt.key_file = argv[++i];
+        } else if (strcmp(argv[i], "--plain-previews") == 0) {
+            crypt.plain_previews = 1;
+        } else if (strcmp(argv[i], "--bench-crypto") == 0) {
+            return bench_crypto();
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "sync") == 0 && i+1 < argc) {
+            sync_dir = argv[++i];
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             usage(argv[0]); return 0;
         }
     }
 
-    if (chub_db_open(g_db_path) != 0) {
-        chub_log("ERR", "Failed to open DB at %s", g_db_path);
+    chub_db_configure(&dbcfg);
+    chub_db_configure_crypt(&crypt);
+    if (stats) return print_stats();
+    snprintf(g_snap_path, sizeof(g_snap_path), "%s.snap", g_db_path);
+    if (sync_dir) return run_sync(sync_dir);
+    if (chub_secret_init(g_secret_rules) != 0) {
+        chub_log("ERR", "Failed to load secret rules from %s", g_secret_rules ? g_secret_rules : "(built-in)");
         return 1;
     }
 
+    if ((crypt.key_file || (crypt.passphrase && *crypt.passphrase)) && !crypt.plain_previews) {
+        g_snapshots = 0;
+        DeleteFileA(g_snap_path);  /* may predate encryption */
+    } else {
+        chub_snapshot_open(g_snap_path);  /* optional: missing/stale file just means no early paint */
+    }
+
+    /* DB is opened by the poller so the first frame doesn't wait on SQLite */
     HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, poller_thread, NULL, 0, NULL);
     if (!hThread) {
         chub_log("ERR", "Failed to start poller thread");
-        chub_db_close();
+        chub_snapshot_close();
         return 1;
     }
 
+    if (chub_clip_writer_start() != 0)
+        chub_log("WARN", "Clipboard writer unavailable; copy-back disabled");
+
     int rc = chub_tui_mainloop();
 
     InterlockedExchange(&g_stop, 1);
     WaitForSingleObject(hThread, INFINITE);
     CloseHandle(hThread);
+    chub_clip_writer_stop();  /* after the poller: it consults the self-write tags */
+    chub_scan_stop();
+    chub_snapshot_close();
+    if (InterlockedCompareExchange(&g_db_failed, 0, 0)) {
+        chub_db_close();
+        chub_log("ERR", "Failed to open DB at %s", g_db_path);
+        return 1;
+    }
+    write_snapshot();
     chub_db_close();
+    log_secret_hits();
+    chub_secret_free();
     return rc;
 }
@@ -0,0 +1,607 @@
+#include "chub/regex.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RE_MAX_NODES   4096
+#define RE_MAX_DEPTH   64     /* groups plus stacked quantifiers; bounds the recursion
+                                 of the parser, gen() and req_of() */
+#define RE_MAX_INSTS   16384
+#define RE_MAX_REPEAT  1000
+#define RE_MAX_LITS    8      /* alternatives kept for the prefilter */
+#define RE_LIT_LEN     64
+#define RE_STACK_INSTS 256    /* VM lists live on the stack below this */
+
+/* ----- AST ----- */
+
+enum { N_EMPTY, N_CHAR, N_ANY, N_CLASS, N_BOL, N_EOL, N_CAT, N_ALT, N_REP };
+
+typedef struct {
+    int type;
+    int first, next;     /* children list (CAT/ALT/REP) and sibling link */
+    int min, max;        /* REP; max < 0 = unbounded */
+    int cls;             /* CLASS index */
+    unsigned char c;     /* CHAR */
+} re_node;
+
+typedef struct { unsigned char bits[32]; } re_class;
+
+/* ----- program ----- */
+
+enum { I_CHAR, I_ANY, I_CLASS, I_SPLIT, I_JMP, I_BOL, I_EOL, I_MATCH };
+
+typedef struct {
+    int op;
+    int x, y;            /* SPLIT/JMP targets, CLASS index */
+    unsigned char c;
+} re_inst;
+
+typedef struct {
+    char s[RE_LIT_LEN];
+    int n;
+} re_lit;
+
+struct chub_regex {
+    re_inst  *prog;
+    int       ninst;
+    re_class *cls;
+    int       ncls;
+    int       icase;
+    re_lit    lits[RE_MAX_LITS];  /* any one must occur; nlits == 0 = no prefilter */
+    int       nlits;
+    int       lit_pick[RE_MAX_LITS]; /* index of the rarest byte, scanned with memchr */
+};
+
+typedef struct {
+    const char *p;
+    re_node nodes[RE_MAX_NODES];
+    int nnodes;
+    re_class *cls;
+    int ncls, cap_cls;
+    int icase;
+    int depth;
+    const char *err;
+} re_parser;
+
+static int new_node(re_parser *ps, int type) {
+    if (ps->nnodes >= RE_MAX_NODES) { ps->err = "pattern too large"; return -1; }
+    re_node *n = &ps->nodes[ps->nnodes];
+    memset(n, 0, sizeof(*n));
+    n->type = type; n->first = -1; n->next = -1;
+    return ps->nnodes++;
+}
+
+static int new_class(re_parser *ps) {
+    if (ps->ncls == ps->cap_cls) {
+        int ncap = ps->cap_cls ? ps->cap_cls * 2 : 8;
+        re_class *c = (re_class*)realloc(ps->cls, (size_t)ncap * sizeof(re_class));
+        if (!c) { ps->err = "out of memory"; return -1; }
+        ps->cls = c; ps->cap_cls = ncap;
+    }
+    memset(&ps->cls[ps->ncls], 0, sizeof(re_class));
+    return ps->ncls++;
+}
+
+static void cls_set(re_class *c, unsigned char b) { c->bits[b >> 3] |= (unsigned char)(1u << (b & 7)); }
+static int  cls_has(const re_class *c, unsigned char b) { return (c->bits[b >> 3] >> (b & 7)) & 1; }
+
+static void cls_set_icase(re_class *c, unsigned char b, int icase) {
+    cls_set(c, b);
+    if (icase && isalpha(b)) {
+        cls_set(c, (unsigned char)tolower(b));
+        cls_set(c, (unsigned char)toupper(b));
+    }
+}
+
+/* \d \w \s and their negations; returns 0 if e isn't a class escape */
+static int cls_escape(re_class *c, char e) {
+    int neg = isupper((unsigned char)e);
+    char k = (char)tolower((unsigned char)e);
+    if (k != 'd' && k != 'w' && k != 's') return 0;
+    for (int b = 0; b < 256; ++b) {
+        int in = k == 'd' ? isdigit(b)
+               : k == 'w' ? (isalnum(b) || b == '_')
+               : (b == ' ' || (b >= '\t' && b <= '\r'));
+        if (in != neg) cls_set(c, (unsigned char)b);
+    }
+    return 1;
+}
+
+/* \n \t \r or an escaped punctuation byte; -1 for anything else (\b, \x41,
+   \1 ...) so an unsupported escape fails instead of matching a letter */
+static int escape_byte(re_parser *ps, char e) {
+    switch (e) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        default:
+            if (ispunct((unsigned char)e)) return (unsigned char)e;
+            ps->err = "unsupported escape";
+            return -1;
+    }
+}
+
+static int parse_alt(re_parser *ps);
+
+static int parse_class(re_parser *ps) {
+    int ci = new_class(ps);
+    if (ci < 0) return -1;
+    int neg = 0;
+    if (*ps->p == '^') { neg = 1; ps->p++; }
+    int first = 1;
+    while (*ps->p && (*ps->p != ']' || first)) {
+        first = 0;
+        int lo;
+        if (*ps->p == '\\' && ps->p[1]) {
+            if (cls_escape(&ps->cls[ci], ps->p[1])) { ps->p += 2; continue; }
+            if ((lo = escape_byte(ps, ps->p[1])) < 0) return -1;
+            ps->p += 2;
+        } else {
+            lo = (unsigned char)*ps->p++;
+        }
+        int hi = lo;
+        if (*ps->p == '-' && ps->p[1] && ps->p[1] != ']') {
+            ps->p++;
+            if (*ps->p == '\\' && ps->p[1]) {
+                if ((hi = escape_byte(ps, ps->p[1])) < 0) return -1;
+                ps->p += 2;
+            } else {
+                hi = (unsigned char)*ps->p++;
+            }
+            if (hi < lo) { ps->err = "bad class range"; return -1; }
+        }
+        for (int b = lo; b <= hi; ++b) cls_set_icase(&ps->cls[ci], (unsigned char)b, ps->icase);
+    }
+    if (*ps->p != ']') { ps->err = "missing ]"; return -1; }
+    ps->p++;
+    if (neg) for (int i = 0; i < 32; ++i) ps->cls[ci].bits[i] = (unsigned char)~ps->cls[ci].bits[i];
+    int n = new_node(ps, N_CLASS);
+    if (n >= 0) ps->nodes[n].cls = ci;
+    return n;
+}
+
+static int char_node(re_parser *ps, unsigned char c) {
+    if (ps->icase && isalpha(c)) {
+        int ci = new_class(ps);
+        if (ci < 0) return -1;
+        cls_set_icase(&ps->cls[ci], c, 1);
+        int n = new_node(ps, N_CLASS);
+        if (n >= 0) ps->nodes[n].cls = ci;
+        return n;
+    }
+    int n = new_node(ps, N_CHAR);
+    if (n >= 0) ps->nodes[n].c = c;
+    return n;
+}
+
+static int parse_atom(re_parser *ps) {
+    char ch = *ps->p;
+    switch (ch) {
+        case '(': {
+            ps->p++;
+            if (ps->p[0] == '?' && ps->p[1] == ':') ps->p += 2;
+            if (++ps->depth > RE_MAX_DEPTH) { ps->err = "groups nested too deeply"; return -1; }
+            int n = parse_alt(ps);
+            ps->depth--;
+            if (n < 0) return -1;
+            if (*ps->p != ')') { ps->err = "missing )"; return -1; }
+            ps->p++;
+            return n;
+        }
+        case '[': ps->p++; return parse_class(ps);
+        case '.': ps->p++; return new_node(ps, N_ANY);
+        case '^': ps->p++; return new_node(ps, N_BOL);
+        case '$': ps->p++; return new_node(ps, N_EOL);
+        case '\\': {
+            if (!ps->p[1]) { ps->err = "trailing \\"; return -1; }
+            char e = ps->p[1];
+            ps->p += 2;
+            if (strchr("dDwWsS", e)) {
+                int ci = new_class(ps);
+                if (ci < 0) return -1;
+                cls_escape(&ps->cls[ci], e);
+                int n = new_node(ps, N_CLASS);
+                if (n >= 0) ps->nodes[n].cls = ci;
+                return n;
+            }
+            int b = escape_byte(ps, e);
+            return b < 0 ? -1 : char_node(ps, (unsigned char)b);
+        }
+        case '*': case '+': case '?': case '{':
+            ps->err = "nothing to repeat";
+            return -1;
+        default:
+            ps->p++;
+            return char_node(ps, (unsigned char)ch);
+    }
+}
+
+static int parse_int(re_parser *ps, int *out) {
+    if (!isdigit((unsigned char)*ps->p)) return 0;
+    long v = 0;
+    while (isdigit((unsigned char)*ps->p)) {
+        v = v * 10 + (*ps->p++ - '0');
+        if (v > RE_MAX_REPEAT) { ps->err = "repeat count too large"; return -1; }
+    }
+    *out = (int)v;
+    return 1;
+}
+
+static int parse_repeat(re_parser *ps) {
+    int atom = parse_atom(ps);
+    int stacked = 0;  /* a+*?... nests one REP node per quantifier */
+    while (atom >= 0) {
+        int min, max;
+        char q = *ps->p;
+        if (q == '*')      { min = 0; max = -1; ps->p++; }
+        else if (q == '+') { min = 1; max = -1; ps->p++; }
+        else if (q == '?') { min = 0; max = 1;  ps->p++; }
+        else if (q == '{') {
+            const char *save = ps->p++;
+            int r = parse_int(ps, &min);
+            if (r < 0) return -1;
+            if (r == 0) { ps->p = save; break; }  /* literal '{' handled by caller */
+            max = min;
+            if (*ps->p == ',') {
+                ps->p++;
+                r = parse_int(ps, &max);
+                if (r < 0) return -1;
+                if (r == 0) max = -1;
+            }
+            if (*ps->p != '}' || (max >= 0 && max < min)) { ps->err = "bad {m,n}"; return -1; }
+            ps->p++;
+        } else break;
+        if (*ps->p == '?') ps->p++;  /* lazy: same result for a yes/no match */
+        if (ps->depth + ++stacked > RE_MAX_DEPTH) { ps->err = "quantifiers nested too deeply"; return -1; }
+        int rep = new_node(ps, N_REP);
+        if (rep < 0) return -1;
+        ps->nodes[rep].first = atom;
+        ps->nodes[rep].min = min;
+        ps->nodes[rep].max = max;
+        atom = rep;
+    }
+    return atom;
+}
+
+static int parse_cat(re_parser *ps) {
+    int cat = new_node(ps, N_CAT);
+    if (cat < 0) return -1;
+    int last = -1;
+    while (*ps->p && *ps->p != '|' && *ps->p != ')') {
+        int n;
+        if (*ps->p == '{') { ps->p++; n = char_node(ps, '{'); }  /* not a valid repeat */
+        else n = parse_repeat(ps);
+        if (n < 0) return -1;
+        if (last < 0) ps->nodes[cat].first = n; else ps->nodes[last].next = n;
+        last = n;
+    }
+    return cat;
+}
+
+static int parse_alt(re_parser *ps) {
+    int first = parse_cat(ps);
+    if (first < 0 || *ps->p != '|') return first;
+    int alt = new_node(ps, N_ALT);
+    if (alt < 0) return -1;
+    ps->nodes[alt].first = first;
+    int last = first;
+    while (*ps->p == '|') {
+        ps->p++;
+        int n = parse_cat(ps);
+        if (n < 0) return -1;
+        ps->nodes[last].next = n;
+        last = n;
+    }
+    return alt;
+}
+
+/* ----- codegen ----- */
+
+typedef struct {
+    re_inst *prog;
+    int n, cap;
+    const re_node *nodes;
+    const char *err;
+} re_gen;
+
+static int emit(re_gen *g, int op, int x, int y, unsigned char c) {
+    if (g->n >= RE_MAX_INSTS) { g->err = "pattern too large"; return -1; }
+    if (g->n == g->cap) {
+        int ncap = g->cap ? g->cap * 2 : 64;
+        re_inst *p = (re_inst*)realloc(g->prog, (size_t)ncap * sizeof(re_inst));
+        if (!p) { g->err = "out of memory"; return -1; }
+        g->prog = p; g->cap = ncap;
+    }
+    re_inst *in = &g->prog[g->n];
+    in->op = op; in->x = x; in->y = y; in->c = c;
+    return g->n++;
+}
+
+static int gen(re_gen *g, int ni) {
+    const re_node *n = &g->nodes[ni];
+    switch (n->type) {
+        case N_EMPTY: return 0;
+        case N_CHAR:  return emit(g, I_CHAR, 0, 0, n->c) < 0 ? -1 : 0;
+        case N_ANY:   return emit(g, I_ANY, 0, 0, 0) < 0 ? -1 : 0;
+        case N_CLASS: return emit(g, I_CLASS, n->cls, 0, 0) < 0 ? -1 : 0;
+        case N_BOL:   return emit(g, I_BOL, 0, 0, 0) < 0 ? -1 : 0;
+        case N_EOL:   return emit(g, I_EOL, 0, 0, 0) < 0 ? -1 : 0;
+        case N_CAT:
+            for (int c = n->first; c >= 0; c = g->nodes[c].next)
+                if (gen(g, c) < 0) return -1;
+            return 0;
+        case N_ALT: {
+            int pending = -1;  /* JMPs to the end, chained through their x */
+            for (int c = n->first; c >= 0; c = g->nodes[c].next) {
+                if (g->nodes[c].next < 0) { if (gen(g, c) < 0) return -1; break; }
+                int split = emit(g, I_SPLIT, 0, 0, 0);
+                if (split < 0) return -1;
+                g->prog[split].x = g->n;
+                if (gen(g, c) < 0) return -1;
+                int jmp = emit(g, I_JMP, pending, 0, 0);
+                if (jmp < 0) return -1;
+                pending = jmp;
+                g->prog[split].y = g->n;
+            }
+            while (pending >= 0) {
+                int prev = g->prog[pending].x;
+                g->prog[pending].x = g->n;
+                pending = prev;
+            }
+            return 0;
+        }
+        case N_REP: {
+            for (int i = 0; i < n->min; ++i)
+                if (gen(g, n->first) < 0) return -1;
+            if (n->max < 0) {
+                int split = emit(g, I_SPLIT, 0, 0, 0);
+                if (split < 0) return -1;
+                g->prog[split].x = g->n;
+                if (gen(g, n->first) < 0) return -1;
+                if (emit(g, I_JMP, split, 0, 0) < 0) return -1;
+                g->prog[split].y = g->n;
+                return 0;
+            }
+            int start = g->n;
+            for (int i = n->min; i < n->max; ++i) {
+                int split = emit(g, I_SPLIT, 0, 0, 0);
+                if (split < 0) return -1;
+                g->prog[split].x = g->n;
+                if (gen(g, n->first) < 0) return -1;
+            }
+            /* every optional copy may bail straight to the end */
+            for (int pc = start; pc < g->n; ++pc)
+                if (g->prog[pc].op == I_SPLIT && g->prog[pc].y == 0 && g->prog[pc].x == pc + 1)
+                    g->prog[pc].y = g->n;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* ----- required literals ----- */
+
+typedef struct {
+    re_lit lits[RE_MAX_LITS];
+    int n;              /* 0 = nothing required */
+} re_req;
+
+static int req_score(const re_req *r) {
+    if (r->n == 0) return 0;
+    int shortest = RE_LIT_LEN;
+    for (int i = 0; i < r->n; ++i) if (r->lits[i].n < shortest) shortest = r->lits[i].n;
+    return shortest * 16 - r->n;  /* longer and fewer alternatives filter better */
+}
+
+static void req_keep_better(re_req *best, const re_req *cand) {
+    if (req_score(cand) > req_score(best)) *best = *cand;
+}
+
+static void req_of(const re_node *nodes, int ni, re_req *out) {
+    const re_node *n = &nodes[ni];
+    out->n = 0;
+    switch (n->type) {
+        case N_CHAR:
+            out->n = 1;
+            out->lits[0].s[0] = (char)n->c;
+            out->lits[0].n = 1;
+            return;
+        case N_CAT: {
+            re_req run, sub;
+            run.n = 0;
+            for (int c = n->first; c >= 0; c = nodes[c].next) {
+                if (nodes[c].type == N_CHAR) {
+                    /* extend the current literal run */
+                    if (run.n == 0) { run.n = 1; run.lits[0].n = 0; }
+                    if (run.lits[0].n < RE_LIT_LEN) run.lits[0].s[run.lits[0].n++] = (char)nodes[c].c;
+                    continue;
+                }
+                if (nodes[c].type == N_BOL || nodes[c].type == N_EOL) continue;
+                req_keep_better(out, &run);
+                run.n = 0;
+                req_of(nodes, c, &sub);
+                req_keep_better(out, &sub);
+            }
+            req_keep_better(out, &run);
+            return;
+        }
+        case N_ALT: {
+            re_req sub;
+            for (int c = n->first; c >= 0; c = nodes[c].next) {
+                req_of(nodes, c, &sub);
+                if (sub.n == 0 || out->n + sub.n > RE_MAX_LITS) { out->n = 0; return; }
+                memcpy(&out->lits[out->n], sub.lits, (size_t)sub.n * sizeof(re_lit));
+                out->n += sub.n;
+            }
+            return;
+        }
+        case N_REP:
+            if (n->min > 0) req_of(nodes, n->first, out);
+            return;
+        default:
+            return;
+    }
+}
+
+/* higher = rarer in typical clipboard text */
+static int byte_rank(unsigned char c) {
+    if (c == ' ' || c == '\n') return 0;
+    if (strchr("etaoinsrhl", c)) return 1;
+    if (islower(c)) return 2;
+    if (isdigit(c)) return 3;
+    if (isupper(c)) return 4;
+    if (c < 0x80) return 5;
+    return 3;  /* UTF-8 bytes: common in non-English text */
+}
+
+/* ----- public ----- */
+
+int chub_regex_compile(const char *pattern, chub_regex **out, char *err, size_t err_sz) {
+    if (!pattern || !out) return 1;
+    *out = NULL;
+    re_parser *ps = (re_parser*)calloc(1, sizeof(re_parser));
+    if (!ps) return 2;
+    ps->p = pattern;
+    if (strncmp(ps->p, "(?i)", 4) == 0) { ps->icase = 1; ps->p += 4; }
+    int root = parse_alt(ps);
+    if (root >= 0 && *ps->p) { ps->err = "unmatched )"; root = -1; }
+
+    re_gen g;
+    memset(&g, 0, sizeof(g));
+    g.nodes = ps->nodes;
+    if (root >= 0 && (gen(&g, root) < 0 || emit(&g, I_MATCH, 0, 0, 0) < 0)) {
+        ps->err = g.err;
+        root = -1;
+    }
+    if (root < 0) {
+        if (err && err_sz) snprintf(err, err_sz, "%s", ps->err ? ps->err : "invalid pattern");
+        free(g.prog); free(ps->cls); free(ps);
+        return 3;
+    }
+
+    chub_regex *re = (chub_regex*)calloc(1, sizeof(chub_regex));
+    if (!re) { free(g.prog); free(ps->cls); free(ps); return 2; }
+    re->prog = g.prog; re->ninst = g.n;
+    re->cls = ps->cls; re->ncls = ps->ncls;
+    re->icase = ps->icase;
+    if (!ps->icase) {
+        /* case-folded letters compile to classes, so only exact patterns get literals */
+        re_req req;
+        req_of(ps->nodes, root, &req);
+        re->nlits = req.n;
+        memcpy(re->lits, req.lits, (size_t)req.n * sizeof(re_lit));
+        for (int i = 0; i < re->nlits; ++i) {
+            int best = 0;
+            for (int k = 1; k < re->lits[i].n; ++k)
+                if (byte_rank((unsigned char)re->lits[i].s[k]) > byte_rank((unsigned char)re->lits[i].s[best]))
+                    best = k;
+            re->lit_pick[i] = best;
+        }
+    }
+    free(ps);
+    *out = re;
+    return 0;
+}
+
+void chub_regex_free(chub_regex *re) {
+    if (!re) return;
+    free(re->prog);
+    free(re->cls);
+    free(re);
+}
+
+/* memmem driven by memchr on the literal's rarest byte (vectorized in the CRT) */
+static int contains_lit(const char *s, size_t len, const re_lit *lit, int pick) {
+    size_t n = (size_t)lit->n;
+    if (n > len) return 0;
+    const char *end = s + len;
+    const char *p = s + pick;
+    unsigned char key = (unsigned char)lit->s[pick];
+    while (p < end) {
+        const char *hit = (const char*)memchr(p, key, (size_t)(end - p));
+        if (!hit) return 0;
+        const char *start = hit - pick;
+        if (start + n <= end && memcmp(start, lit->s, n) == 0) return 1;
+        p = hit + 1;
+    }
+    return 0;
+}
+
+int chub_regex_prefilter(const chub_regex *re, const char *s, size_t len) {
+    if (!re || re->nlits == 0) return 1;
+    for (int i = 0; i < re->nlits; ++i)
+        if (contains_lit(s, len, &re->lits[i], re->lit_pick[i])) return 1;
+    return 0;
+}
+
+typedef struct {
+    int *pcs;
+    int n;
+} re_list;
+
+/* epsilon closure of pc into list; marks dedupe within one step */
+static void add_thread(const chub_regex *re, re_list *l, unsigned *mark, unsigned gen_,
+                       int *stack, int pc, const char *s, size_t len, size_t pos) {
+    int sp = 0;
+    stack[sp++] = pc;
+    while (sp > 0) {
+        pc = stack[--sp];
+        if (mark[pc] == gen_) continue;
+        mark[pc] = gen_;
+        const re_inst *in = &re->prog[pc];
+        switch (in->op) {
+            case I_JMP:   stack[sp++] = in->x; break;
+            case I_SPLIT: stack[sp++] = in->y; stack[sp++] = in->x; break;
+            case I_BOL:   if (pos == 0 || s[pos - 1] == '\n') stack[sp++] = pc + 1; break;
+            case I_EOL:   if (pos == len || s[pos] == '\n') stack[sp++] = pc + 1; break;
+            default:      l->pcs[l->n++] = pc; break;
+        }
+    }
+}
+
+int chub_regex_match(const chub_regex *re, const char *s, size_t len) {
+    if (!re || !s) return 0;
+    if (!chub_regex_prefilter(re, s, len)) return 0;
+
+    int n = re->ninst;
+    int stack_buf[4 * RE_STACK_INSTS];
+    unsigned mark_buf[RE_STACK_INSTS];
+    int *mem = NULL;
+    int *pa, *pb, *stack;
+    unsigned *mark;
+    if (n <= RE_STACK_INSTS) {
+        pa = stack_buf; pb = stack_buf + n; stack = stack_buf + 2 * n; mark = mark_buf;
+    } else {
+        mem = (int*)malloc((size_t)n * (4 * sizeof(int) + sizeof(unsigned)));
+        if (!mem) return 0;
+        pa = mem; pb = mem + n; stack = mem + 2 * n; mark = (unsigned*)(mem + 4 * n);
+    }
+    memset(mark, 0, (size_t)n * sizeof(unsigned));
+
+    re_list clist = { pa, 0 }, nlist = { pb, 0 };
+    unsigned gen_ = 1;
+    int matched = 0;
+    for (size_t pos = 0; pos <= len && !matched; ++pos) {
+        add_thread(re, &clist, mark, gen_, stack, 0, s, len, pos);  /* unanchored start */
+        ++gen_;
+        nlist.n = 0;
+        unsigned char c = pos < len ? (unsigned char)s[pos] : 0;
+        for (int i = 0; i < clist.n; ++i) {
+            const re_inst *in = &re->prog[clist.pcs[i]];
+            int ok = 0;
+            switch (in->op) {
+                case I_MATCH: matched = 1; break;
+                case I_CHAR:  ok = pos < len && c == in->c; break;
+                case I_ANY:   ok = pos < len && c != '\n'; break;
+                case I_CLASS: ok = pos < len && cls_has(&re->cls[in->x], c); break;
+                default: break;
+            }
+            if (matched) break;
+            if (ok) add_thread(re, &nlist, mark, gen_, stack, clist.pcs[i] + 1, s, len, pos + 1);
+        }
+        re_list t = clist; clist = nlist; nlist = t;
+    }
+    free(mem);
+    return matched;
+}
@@ -0,0 +1,128 @@
+#include "chub/resultset.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RS_INITIAL_ROWS 64
+#define RS_INITIAL_TEXT 4096
+
+/* bytes per row across all columns; widest first to keep them aligned */
+#define RS_ROW_BYTES (sizeof(long long) + sizeof(unsigned long long) + \
+                      sizeof(int) + 3 * sizeof(unsigned int) + sizeof(unsigned char))
+
+struct chub_resultset {
+    int count;
+    int cap;
+    /* columns, all carved out of `hot` */
+    long long *ts;
+    unsigned long long *h;
+    int *id;
+    unsigned int *off;      /* into text */
+    unsigned int *len;
+    unsigned int *full;     /* length of the whole entry; > len for previews */
+    unsigned char *fav;
+    unsigned char *hot;
+    /* packed NUL-terminated texts */
+    char *text;
+    size_t text_used;
+    size_t text_cap;
+};
+
+static void carve(chub_resultset *rs, unsigned char *block, int cap) {
+    size_t n = (size_t)cap;
+    rs->ts  = (long long*)block;
+    rs->h   = (unsigned long long*)(block + n * sizeof(long long));
+    rs->id  = (int*)((unsigned char*)rs->h + n * sizeof(unsigned long long));
+    rs->off = (unsigned int*)((unsigned char*)rs->id + n * sizeof(int));
+    rs->len = rs->off + n;
+    rs->full = rs->len + n;
+    rs->fav = (unsigned char*)(rs->full + n);
+    rs->hot = block;
+}
+
+static int grow_rows(chub_resultset *rs) {
+    int ncap = rs->cap ? rs->cap * 2 : RS_INITIAL_ROWS;
+    unsigned char *block = (unsigned char*)malloc((size_t)ncap * RS_ROW_BYTES);
+    if (!block) return 1;
+    chub_resultset old = *rs;
+    carve(rs, block, ncap);
+    if (old.hot) {
+        size_t n = (size_t)old.count;
+        memcpy(rs->ts,  old.ts,  n * sizeof(*rs->ts));
+        memcpy(rs->h,   old.h,   n * sizeof(*rs->h));
+        memcpy(rs->id,  old.id,  n * sizeof(*rs->id));
+        memcpy(rs->off, old.off, n * sizeof(*rs->off));
+        memcpy(rs->len, old.len, n * sizeof(*rs->len));
+        memcpy(rs->full, old.full, n * sizeof(*rs->full));
+        memcpy(rs->fav, old.fav, n * sizeof(*rs->fav));
+        free(old.hot);
+    }
+    rs->cap = ncap;
+    return 0;
+}
+
+static int grow_text(chub_resultset *rs, size_t need) {
+    size_t ncap = rs->text_cap ? rs->text_cap : RS_INITIAL_TEXT;
+    while (ncap - rs->text_used < need) ncap *= 2;
+    if (ncap > 0xFFFFFFFFu) return 1;   /* offsets are 32-bit */
+    char *t = (char*)realloc(rs->text, ncap);
+    if (!t) return 1;
+    rs->text = t;
+    rs->text_cap = ncap;
+    return 0;
+}
+
+chub_resultset *chub_rs_new(void) {
+    return (chub_resultset*)calloc(1, sizeof(chub_resultset));
+}
+
+void chub_rs_free(chub_resultset *rs) {
+    if (!rs) return;
+    free(rs->hot);
+    free(rs->text);
+    free(rs);
+}
+
+int chub_rs_push(chub_resultset *rs, int id, long long ts, int favorite,
+                 unsigned long long h, const char *text, size_t len) {
+    return chub_rs_push_preview(rs, id, ts, favorite, h, text, len, text ? len : 0);
+}
+
+int chub_rs_push_preview(chub_resultset *rs, int id, long long ts, int favorite,
+                         unsigned long long h, const char *text, size_t len, size_t full_len) {
+    if (!rs) return 1;
+    if (!text) len = 0;
+    if (rs->count == rs->cap && grow_rows(rs) != 0) return 2;
+    if (rs->text_cap - rs->text_used < len + 1 && grow_text(rs, len + 1) != 0) return 2;
+    int i = rs->count++;
+    rs->ts[i]  = ts;
+    rs->h[i]   = h;
+    rs->id[i]  = id;
+    rs->off[i] = (unsigned int)rs->text_used;
+    rs->len[i] = (unsigned int)len;
+    rs->full[i] = (unsigned int)(full_len > len ? full_len : len);
+    rs->fav[i] = (unsigned char)(favorite ? 1 : 0);
+    if (len) memcpy(rs->text + rs->text_used, text, len);
+    rs->text[rs->text_used + len] = '\0';
+    rs->text_used += len + 1;
+    return 0;
+}
+
+int chub_rs_count(const chub_resultset *rs) { return rs ? rs->count : 0; }
+int chub_rs_id(const chub_resultset *rs, int i) { return rs->id[i]; }
+long long chub_rs_ts(const chub_resultset *rs, int i) { return rs->ts[i]; }
+int chub_rs_favorite(const chub_resultset *rs, int i) { return rs->fav[i]; }
+unsigned long long chub_rs_hash(const chub_resultset *rs, int i) { return rs->h[i]; }
+size_t chub_rs_length(const chub_resultset *rs, int i) { return rs->len[i]; }
+size_t chub_rs_full_length(const chub_resultset *rs, int i) { return rs->full[i]; }
+int chub_rs_is_preview(const chub_resultset *rs, int i) { return rs->full[i] > rs->len[i]; }
+const char *chub_rs_text(const chub_resultset *rs, int i) { return rs->text + rs->off[i]; }
+
+int chub_rs_find_id(const chub_resultset *rs, int id) {
+    if (!rs) return -1;
+    for (int i = 0; i < rs->count; ++i) if (rs->id[i] == id) return i;
+    return -1;
+}
+
+void chub_rs_set_favorite(chub_resultset *rs, int i, int favorite) {
+    rs->fav[i] = (unsigned char)(favorite ? 1 : 0);
+}
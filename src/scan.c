@@ -0,0 +1,344 @@
+#include "chub/scan.h"
+#include "chub/db.h"
+#include "chub/regex.h"
+#include "chub/util.h"
+#include <sqlite3.h>
+#include <windows.h>
+#include <process.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCAN_MAX_THREADS   64
+#define SHARDS_PER_WORKER  8    /* spare shards give thieves something to take */
+#define DEADLINE_EVERY     64   /* rows between clock reads */
+
+typedef struct {
+    double score;
+    long long ts;
+    int id;
+} scan_hit;
+
+typedef struct {
+    HANDLE thread;
+    int index;
+    sqlite3 *db;               /* read-only, owned by this worker */
+    sqlite3_stmt *st;
+    CRITICAL_SECTION qcs;      /* guards lo/hi */
+    int lo, hi;                /* shard deque: owner pops lo, thieves take hi */
+    scan_hit *heap;            /* min-heap of the best `limit` rows */
+    int nheap, capheap;
+} scan_worker;
+
+static scan_worker g_w[SCAN_MAX_THREADS];
+static int g_n = 0;
+static volatile LONG g_started = 0;    /* g_n and g_w[] are final; set last by chub_scan_start */
+static CRITICAL_SECTION g_pool_cs;
+static CRITICAL_SECTION g_run_cs;      /* one scan at a time */
+static CONDITION_VARIABLE g_work_cv, g_done_cv;
+static unsigned g_gen = 0;             /* bumped per job */
+static int g_active = 0;               /* workers still on the current job */
+static int g_quit = 0;
+
+/* current job; written by chub_scan_run while workers are idle */
+static const chub_scan_query *g_q = NULL;
+static long long g_base = 0, g_width = 1;
+static long long g_deadline = 0;
+static volatile LONG g_interrupted = 0;
+
+/* ----- top-K ----- */
+
+static int hit_better(const scan_hit *a, const scan_hit *b) {
+    if (a->score != b->score) return a->score > b->score;
+    if (a->ts != b->ts) return a->ts > b->ts;
+    return a->id > b->id;
+}
+
+static void heap_sift_down(scan_hit *h, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && hit_better(&h[m], &h[l])) m = l;
+        if (r < n && hit_better(&h[m], &h[r])) m = r;
+        if (m == i) return;
+        scan_hit t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+static void heap_push(scan_worker *w, int limit, const scan_hit *hit) {
+    scan_hit *h = w->heap;
+    if (w->nheap < limit) {
+        int i = w->nheap++;
+        h[i] = *hit;
+        while (i > 0 && hit_better(&h[(i - 1) / 2], &h[i])) {
+            scan_hit t = h[i]; h[i] = h[(i - 1) / 2]; h[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    } else if (hit_better(hit, &h[0])) {
+        h[0] = *hit;
+        heap_sift_down(h, w->nheap, 0);
+    }
+}
+
+static int cmp_hits_desc(const void *a, const void *b) {
+    const scan_hit *x = (const scan_hit*)a, *y = (const scan_hit*)b;
+    if (hit_better(x, y)) return -1;
+    if (hit_better(y, x)) return 1;
+    return 0;
+}
+
+/* ----- workers ----- */
+
+static int take_shard(int self) {
+    scan_worker *w = &g_w[self];
+    int s = -1;
+    EnterCriticalSection(&w->qcs);
+    if (w->lo < w->hi) s = w->lo++;
+    LeaveCriticalSection(&w->qcs);
+    for (int k = 1; s < 0 && k < g_n; ++k) {
+        scan_worker *v = &g_w[(self + k) % g_n];
+        EnterCriticalSection(&v->qcs);
+        if (v->lo < v->hi) s = --v->hi;
+        LeaveCriticalSection(&v->qcs);
+    }
+    return s;
+}
+
+static int stop_requested(void) {
+    return InterlockedCompareExchange(&g_interrupted, 0, 0) != 0;
+}
+
+static void run_job(scan_worker *w) {
+    const chub_scan_query *q = g_q;
+    w->nheap = 0;
+    sqlite3_exec(w->db, "BEGIN", NULL, NULL, NULL);  /* one read snapshot per worker and job (chub/scan.h) */
+    int rows = 0, s;
+    while (!stop_requested() && (s = take_shard(w->index)) >= 0) {
+        long long lo = g_base + (long long)s * g_width;
+        sqlite3_bind_int64(w->st, 1, (sqlite3_int64)lo);
+        sqlite3_bind_int64(w->st, 2, (sqlite3_int64)(lo + g_width - 1));
+        while (sqlite3_step(w->st) == SQLITE_ROW) {
+            if (++rows % DEADLINE_EVERY == 0) {
+                if (g_deadline && chub_now_millis() > g_deadline) InterlockedExchange(&g_interrupted, 1);
+                if (stop_requested()) break;
+            }
+            scan_hit hit;
+            hit.id = sqlite3_column_int(w->st, 0);
+            hit.ts = (long long)sqlite3_column_int64(w->st, 1);
+            hit.score = q->order == CHUB_SCAN_BY_FRECENCY ? sqlite3_column_double(w->st, 3) : 0.0;
+            /* key known up front: a full heap that already beats it skips the match */
+            if (q->order != CHUB_SCAN_BY_SCORE && w->nheap == q->limit && !hit_better(&hit, &w->heap[0])) continue;
+            const char *txt = (const char*)sqlite3_column_text(w->st, 2);
+            size_t len = (size_t)sqlite3_column_bytes(w->st, 2);
+            double score = q->match(txt ? txt : "", len, q->ctx);
+            if (score <= 0.0) continue;
+            if (q->order == CHUB_SCAN_BY_SCORE) hit.score = score;
+            heap_push(w, q->limit, &hit);
+        }
+        sqlite3_reset(w->st);
+    }
+    sqlite3_exec(w->db, "COMMIT", NULL, NULL, NULL);
+}
+
+static unsigned __stdcall worker_thread(void *arg) {
+    scan_worker *w = (scan_worker*)arg;
+    EnterCriticalSection(&g_pool_cs);
+    unsigned seen = 0;  /* g_gen starts at 0; no job can predate the pool */
+    for (;;) {
+        while (g_gen == seen && !g_quit) SleepConditionVariableCS(&g_work_cv, &g_pool_cs, INFINITE);
+        if (g_quit) break;
+        seen = g_gen;
+        LeaveCriticalSection(&g_pool_cs);
+        run_job(w);
+        EnterCriticalSection(&g_pool_cs);
+        if (--g_active == 0) WakeAllConditionVariable(&g_done_cv);
+    }
+    LeaveCriticalSection(&g_pool_cs);
+    return 0;
+}
+
+static void close_worker(scan_worker *w) {
+    if (w->st) sqlite3_finalize(w->st);
+    if (w->db) sqlite3_close(w->db);
+    DeleteCriticalSection(&w->qcs);
+    free(w->heap);
+    memset(w, 0, sizeof(*w));
+}
+
+int chub_scan_start(int threads) {
+    if (g_n) return 0;
+    const char *path = chub_db_path();
+    if (!path) return 1;
+    if (threads <= 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        threads = (int)si.dwNumberOfProcessors;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > SCAN_MAX_THREADS) threads = SCAN_MAX_THREADS;
+
+    InitializeCriticalSection(&g_pool_cs);
+    InitializeCriticalSection(&g_run_cs);
+    InitializeConditionVariable(&g_work_cv);
+    InitializeConditionVariable(&g_done_cv);
+    g_quit = 0;
+    g_gen = 0;
+
+    const char *sql =
+        "SELECT i.id,i.ts," CHUB_DB_TEXT_SQL "," CHUB_DB_RANK_SQL " FROM items i JOIN item_text t ON t.id=i.id "
+        "WHERE i.id BETWEEN ? AND ?";
+    for (int i = 0; i < threads; ++i) {
+        scan_worker *w = &g_w[i];
+        memset(w, 0, sizeof(*w));
+        w->index = i;
+        InitializeCriticalSection(&w->qcs);
+        int opened = sqlite3_open_v2(path, &w->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL) == SQLITE_OK;
+        if (opened) chub_db_register_functions(w->db);
+        if (!opened || sqlite3_prepare_v2(w->db, sql, -1, &w->st, NULL) != SQLITE_OK) {
+            close_worker(w);  /* run with the workers we have */
+            break;
+        }
+        chub_db_apply_pragmas(w->db);
+        w->thread = (HANDLE)_beginthreadex(NULL, 0, worker_thread, w, 0, NULL);
+        if (!w->thread) { close_worker(w); break; }
+        g_n = i + 1;
+    }
+    if (g_n == 0) {
+        DeleteCriticalSection(&g_pool_cs);
+        DeleteCriticalSection(&g_run_cs);
+        return 2;
+    }
+    InterlockedExchange(&g_started, 1);  /* the TUI may search as soon as the DB is ready */
+    return 0;
+}
+
+void chub_scan_stop(void) {
+    if (!g_n) return;
+    InterlockedExchange(&g_started, 0);
+    EnterCriticalSection(&g_pool_cs);
+    g_quit = 1;
+    WakeAllConditionVariable(&g_work_cv);
+    LeaveCriticalSection(&g_pool_cs);
+    for (int i = 0; i < g_n; ++i) {
+        WaitForSingleObject(g_w[i].thread, INFINITE);
+        CloseHandle(g_w[i].thread);
+        close_worker(&g_w[i]);
+    }
+    g_n = 0;
+    DeleteCriticalSection(&g_pool_cs);
+    DeleteCriticalSection(&g_run_cs);
+}
+
+int chub_scan_run(const chub_scan_query *q, chub_resultset **out) {
+    if (!q || !out || q->limit <= 0) return 1;
+    /* facets narrow the candidates through an index; sharding the id
+       space would read every row instead */
+    if (q->facets && q->facets->n > 0)
+        return chub_db_search_kinds(q->facets->any, q->facets->n, q->match, q->ctx,
+                                    q->order, q->limit, q->budget_ms, out);
+    if (!InterlockedCompareExchange(&g_started, 0, 0) || !q->match) return 1;
+    *out = NULL;
+    EnterCriticalSection(&g_run_cs);
+
+    long long min_id = 0, max_id = -1;
+    if (chub_db_id_range(&min_id, &max_id) != 0) { LeaveCriticalSection(&g_run_cs); return 2; }
+    if (max_id < min_id) {
+        LeaveCriticalSection(&g_run_cs);
+        *out = chub_rs_new();
+        return *out ? 0 : 4;
+    }
+
+    long long span = max_id - min_id + 1;
+    long long nshards = (long long)g_n * SHARDS_PER_WORKER;
+    if (nshards > span) nshards = span;
+    g_base = min_id;
+    g_width = (span + nshards - 1) / nshards;
+    nshards = (span + g_width - 1) / g_width;
+
+    for (int i = 0; i < g_n; ++i) {
+        scan_worker *w = &g_w[i];
+        if (w->capheap < q->limit) {
+            scan_hit *h = (scan_hit*)realloc(w->heap, (size_t)q->limit * sizeof(scan_hit));
+            if (!h) { LeaveCriticalSection(&g_run_cs); return 4; }
+            w->heap = h; w->capheap = q->limit;
+        }
+        w->lo = (int)(nshards * i / g_n);
+        w->hi = (int)(nshards * (i + 1) / g_n);
+    }
+    g_q = q;
+    g_deadline = q->budget_ms > 0 ? chub_now_millis() + q->budget_ms : 0;
+    InterlockedExchange(&g_interrupted, 0);
+
+    EnterCriticalSection(&g_pool_cs);
+    g_active = g_n;
+    g_gen++;
+    WakeAllConditionVariable(&g_work_cv);
+    while (g_active > 0) SleepConditionVariableCS(&g_done_cv, &g_pool_cs, INFINITE);
+    LeaveCriticalSection(&g_pool_cs);
+
+    /* merge the per-worker top-K lists */
+    int total = 0;
+    for (int i = 0; i < g_n; ++i) total += g_w[i].nheap;
+    scan_hit *all = (scan_hit*)malloc((size_t)(total ? total : 1) * sizeof(scan_hit));
+    if (!all) { LeaveCriticalSection(&g_run_cs); return 4; }
+    int k = 0;
+    for (int i = 0; i < g_n; ++i) {
+        memcpy(all + k, g_w[i].heap, (size_t)g_w[i].nheap * sizeof(scan_hit));
+        k += g_w[i].nheap;
+    }
+    int interrupted = stop_requested();
+    LeaveCriticalSection(&g_run_cs);
+
+    qsort(all, (size_t)total, sizeof(scan_hit), cmp_hits_desc);
+    if (total > q->limit) total = q->limit;
+    int *ids = (int*)malloc((size_t)(total ? total : 1) * sizeof(int));
+    if (!ids) { free(all); return 4; }
+    for (int i = 0; i < total; ++i) ids[i] = all[i].id;
+    free(all);
+    int rc = chub_db_fetch_ids(ids, total, out);
+    free(ids);
+    if (rc != 0) return rc;
+    return interrupted ? 5 : 0;
+}
+
+/* ----- matchers ----- */
+
+double chub_scan_match_substring(const char *text, size_t len, void *ctx) {
+    const char *needle = (const char*)ctx;
+    size_t n = strlen(needle);
+    if (n == 0) return 1.0;
+    if (n > len) return 0.0;
+    unsigned char lo = (unsigned char)tolower((unsigned char)needle[0]);
+    unsigned char up = (unsigned char)toupper((unsigned char)needle[0]);
+    for (size_t i = 0; i + n <= len; ++i) {
+        unsigned char c = (unsigned char)text[i];
+        if (c != lo && c != up) continue;
+        size_t k = 1;
+        while (k < n && tolower((unsigned char)text[i + k]) == tolower((unsigned char)needle[k])) ++k;
+        if (k == n) return 1.0;
+    }
+    return 0.0;
+}
+
+double chub_scan_match_regex(const char *text, size_t len, void *ctx) {
+    return chub_regex_match((const chub_regex*)ctx, text, len) ? 1.0 : 0.0;
+}
+
+/* every pattern char must appear in order; adjacency and word starts score higher */
+double chub_scan_match_fuzzy(const char *text, size_t len, void *ctx) {
+    const char *p = (const char*)ctx;
+    if (!*p) return 1.0;
+    double score = 0.0;
+    size_t last = (size_t)-1;
+    size_t i = 0;
+    for (; *p; ++p) {
+        int pc = tolower((unsigned char)*p);
+        while (i < len && tolower((unsigned char)text[i]) != pc) ++i;
+        if (i == len) return 0.0;
+        score += 1.0;
+        if (last != (size_t)-1 && i == last + 1) score += 2.0;
+        if (i == 0 || !isalnum((unsigned char)text[i - 1])) score += 1.5;
+        last = i++;
+    }
+    return score / (1.0 + (double)len / 256.0);  /* prefer shorter entries */
+}
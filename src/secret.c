@@ -0,0 +1,404 @@
+#include "chub/secret.h"
+#include "chub/util.h"
+#include <windows.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIT_MAX        64
+#define NAME_MAX_LEN   32
+#define SPANS_INIT     32
+#define ENTROPY_MAX_TOKEN 512
+#define REDACTED       "[redacted]"
+
+enum { R_PREFIX, R_ENTROPY, R_PASSWORD };
+
+/* byte classes; 0 = whitespace. C_TOKEN marks bytes that can appear in a
+   key/token (base64, hex, url-safe), other punctuation splits tokens */
+enum { C_LOWER = 1, C_UPPER = 2, C_DIGIT = 4, C_SYMBOL = 8, C_HIGH = 16, C_TOKEN = 32 };
+#define C_ALNUM (C_LOWER | C_UPPER | C_DIGIT)
+
+typedef struct {
+    int kind;
+    char name[NAME_MAX_LEN];
+    char lit[LIT_MAX];
+    int lit_len;
+    int min_len;         /* PREFIX: token length; ENTROPY/PASSWORD: text/token length */
+    int max_len;         /* PASSWORD */
+    double bits;         /* ENTROPY: bits per char */
+    int block;           /* PREFIX: span runs to the matching -----END line */
+    int flag_only;       /* PASSWORD: counted in the stats but never redacted/dropped */
+} rule;
+
+typedef struct {
+    size_t start, end;
+} span;
+
+static rule g_rules[CHUB_SECRET_MAX_RULES];
+static int g_nrules = 0;
+static volatile LONG g_hits[CHUB_SECRET_MAX_RULES];
+static int g_action = CHUB_SECRET_REDACT;
+static unsigned char g_cls[256];
+
+/* Aho-Corasick DFA over all PREFIX literals */
+static unsigned short *g_delta = NULL;      /* [state * 256 + byte] */
+static unsigned long long *g_out = NULL;    /* rules whose literal ends in state */
+static int g_nstates = 0;
+
+static const char *DEFAULT_RULES =
+    "prefix private-key -----BEGIN 0 block\n"
+    "prefix aws-access-key AKIA 20\n"
+    "prefix aws-temp-key ASIA 20\n"
+    "prefix github-token ghp_ 40\n"
+    "prefix github-token gho_ 40\n"
+    "prefix github-token ghu_ 40\n"
+    "prefix github-token ghs_ 40\n"
+    "prefix github-token ghr_ 40\n"
+    "prefix github-pat github_pat_ 40\n"
+    "prefix slack-token xoxb- 20\n"
+    "prefix slack-token xoxp- 20\n"
+    "prefix stripe-key sk_live_ 24\n"
+    "prefix google-api-key AIza 39\n"
+    "prefix api-key sk- 32\n"
+    "entropy high-entropy 32 4.0\n"
+    "password password-like 10 64\n";
+
+static void init_classes(void) {
+    for (int b = 0; b < 256; ++b) {
+        unsigned char c = 0;
+        if (b >= 0x80) c = C_HIGH;
+        else if (islower(b)) c = C_LOWER | C_TOKEN;
+        else if (isupper(b)) c = C_UPPER | C_TOKEN;
+        else if (isdigit(b)) c = C_DIGIT | C_TOKEN;
+        else if (b > ' ' && b < 0x7F) c = C_SYMBOL;
+        g_cls[b] = c;
+    }
+    const char *tok = "-_+/=.";
+    for (; *tok; ++tok) g_cls[(unsigned char)*tok] |= C_TOKEN;
+}
+
+static int is_token_byte(unsigned char c) {
+    return (g_cls[c] & C_TOKEN) != 0;
+}
+
+/* ----- rules ----- */
+
+static int parse_rules(const char *text) {
+    g_nrules = 0;
+    const char *p = text;
+    while (*p) {
+        const char *eol = strchr(p, '\n');
+        size_t n = eol ? (size_t)(eol - p) : strlen(p);
+        char line[256];
+        if (n >= sizeof(line)) n = sizeof(line) - 1;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        p = eol ? eol + 1 : p + n;
+
+        char kind[16], name[NAME_MAX_LEN], a[LIT_MAX], b[16], c[16];
+        int f = sscanf(line, "%15s %31s %63s %15s %15s", kind, name, a, b, c);
+        if (f <= 0 || kind[0] == '#') continue;
+        if (g_nrules == CHUB_SECRET_MAX_RULES) return 2;
+        rule *r = &g_rules[g_nrules];
+        memset(r, 0, sizeof(*r));
+        snprintf(r->name, sizeof(r->name), "%s", name);
+        if (strcmp(kind, "prefix") == 0 && f >= 3) {
+            r->kind = R_PREFIX;
+            r->lit_len = (int)strlen(a);
+            memcpy(r->lit, a, (size_t)r->lit_len);
+            r->min_len = f >= 4 ? atoi(b) : 0;
+            r->block = f >= 5 && strcmp(c, "block") == 0;
+        } else if (strcmp(kind, "entropy") == 0 && f >= 4) {
+            r->kind = R_ENTROPY;
+            r->min_len = atoi(a);
+            r->bits = atof(b);
+        } else if (strcmp(kind, "password") == 0 && f >= 4) {
+            r->kind = R_PASSWORD;
+            r->min_len = atoi(a);
+            r->max_len = atoi(b);
+            r->flag_only = !(f >= 5 && strcmp(c, "redact") == 0);
+        } else {
+            chub_log("SECRET", "ignoring rule: %s", line);
+            continue;
+        }
+        g_nrules++;
+    }
+    return 0;
+}
+
+static int build_automaton(void) {
+    int max_states = 1;
+    for (int i = 0; i < g_nrules; ++i) if (g_rules[i].kind == R_PREFIX) max_states += g_rules[i].lit_len;
+    if (max_states > 0xFFFF) return 2;
+
+    int *trie = (int*)malloc((size_t)max_states * 256 * sizeof(int));
+    int *fail = (int*)calloc((size_t)max_states, sizeof(int));
+    int *queue = (int*)malloc((size_t)max_states * sizeof(int));
+    g_delta = (unsigned short*)malloc((size_t)max_states * 256 * sizeof(unsigned short));
+    g_out = (unsigned long long*)calloc((size_t)max_states, sizeof(unsigned long long));
+    if (!trie || !fail || !queue || !g_delta || !g_out) {
+        free(trie); free(fail); free(queue);
+        return 3;
+    }
+    memset(trie, 0xFF, (size_t)max_states * 256 * sizeof(int));  /* -1 = no edge */
+
+    g_nstates = 1;
+    for (int i = 0; i < g_nrules; ++i) {
+        if (g_rules[i].kind != R_PREFIX) continue;
+        int s = 0;
+        for (int k = 0; k < g_rules[i].lit_len; ++k) {
+            unsigned char c = (unsigned char)g_rules[i].lit[k];
+            if (trie[s * 256 + c] < 0) trie[s * 256 + c] = g_nstates++;
+            s = trie[s * 256 + c];
+        }
+        g_out[s] |= 1ULL << i;
+    }
+
+    int qh = 0, qt = 0;
+    for (int c = 0; c < 256; ++c) {
+        int t = trie[c];
+        if (t < 0) { g_delta[c] = 0; continue; }
+        g_delta[c] = (unsigned short)t;
+        fail[t] = 0;
+        queue[qt++] = t;
+    }
+    while (qh < qt) {
+        int s = queue[qh++];
+        g_out[s] |= g_out[fail[s]];
+        for (int c = 0; c < 256; ++c) {
+            int t = trie[s * 256 + c];
+            if (t < 0) {
+                g_delta[s * 256 + c] = g_delta[fail[s] * 256 + c];
+            } else {
+                fail[t] = g_delta[fail[s] * 256 + c];
+                g_delta[s * 256 + c] = (unsigned short)t;
+                queue[qt++] = t;
+            }
+        }
+    }
+    free(trie); free(fail); free(queue);
+    return 0;
+}
+
+int chub_secret_init(const char *rules_path) {
+    chub_secret_free();
+    init_classes();
+    int rc;
+    if (rules_path) {
+        FILE *f = fopen(rules_path, "rb");
+        if (!f) return 1;
+        char buf[16 * 1024];
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = '\0';
+        rc = parse_rules(buf);
+    } else {
+        rc = parse_rules(DEFAULT_RULES);
+    }
+    if (rc != 0) return rc;
+    for (int i = 0; i < g_nrules; ++i) InterlockedExchange(&g_hits[i], 0);
+    return build_automaton();
+}
+
+void chub_secret_free(void) {
+    free(g_delta); free(g_out);
+    g_delta = NULL; g_out = NULL; g_nstates = 0;
+    g_nrules = 0;
+}
+
+void chub_secret_set_action(int action) { g_action = action; }
+int  chub_secret_action(void) { return g_action; }
+
+/* ----- detection ----- */
+
+typedef struct {
+    chub_secret_result *res;
+    int record;           /* collect spans (redact); 0 when only counting */
+    span *spans;          /* malloc'd, grown as needed */
+    int nspans, cap;
+    int oom;              /* a span couldn't be kept: the text can't be redacted safely */
+} detect_ctx;
+
+static void add_hit(detect_ctx *d, int rule_idx, size_t start, size_t end) {
+    d->res->rule_mask |= 1ULL << rule_idx;
+    if (g_rules[rule_idx].flag_only) return;
+    d->res->hits++;
+    if (!d->record || d->oom) return;
+    if (d->nspans == d->cap) {
+        int ncap = d->cap ? d->cap * 2 : SPANS_INIT;
+        span *ns = (span*)realloc(d->spans, (size_t)ncap * sizeof(span));
+        if (!ns) { d->oom = 1; return; }
+        d->spans = ns;
+        d->cap = ncap;
+    }
+    d->spans[d->nspans].start = start;
+    d->spans[d->nspans].end = end;
+    d->nspans++;
+}
+
+static size_t block_end(const char *s, size_t len, size_t from) {
+    for (size_t i = from; i + 8 <= len; ++i) {
+        if (s[i] == '-' && memcmp(s + i, "-----END", 8) == 0) {
+            const char *nl = memchr(s + i, '\n', len - i);
+            return nl ? (size_t)(nl - s) : len;
+        }
+    }
+    return len;
+}
+
+/* a literal just ended at byte i: check token boundary and length */
+static void on_literals(detect_ctx *d, const char *s, size_t len, size_t i, unsigned long long mask) {
+    for (int r = 0; mask; ++r, mask >>= 1) {
+        if (!(mask & 1)) continue;
+        const rule *ru = &g_rules[r];
+        size_t start = i + 1 - (size_t)ru->lit_len;
+        if (start > 0 && isalnum((unsigned char)s[start - 1])) continue;
+        size_t end;
+        if (ru->block) {
+            end = block_end(s, len, i + 1);
+        } else {
+            end = i + 1;
+            while (end < len && is_token_byte((unsigned char)s[end])) ++end;
+            if ((int)(end - start) < ru->min_len) continue;
+        }
+        add_hit(d, r, start, end);
+    }
+}
+
+static double entropy_bits(const unsigned char *t, size_t n) {
+    int counts[256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; ++i) counts[t[i]]++;
+    double e = 0.0;
+    for (int b = 0; b < 256; ++b) {
+        if (!counts[b]) continue;
+        double p = (double)counts[b] / (double)n;
+        e -= p * log2(p);
+    }
+    return e;
+}
+
+static void on_token(detect_ctx *d, const char *s, size_t start, size_t end, unsigned classes) {
+    size_t n = end - start;
+    if (n > ENTROPY_MAX_TOKEN || (classes & C_ALNUM) != C_ALNUM) return;
+    /* the path part of a URL is long and random-looking but not a secret */
+    if (start > 0 && s[start - 1] == ':' && s[start] == '/') return;
+    int checked = 0;
+    double e = 0.0;
+    for (int r = 0; r < g_nrules; ++r) {
+        const rule *ru = &g_rules[r];
+        if (ru->kind != R_ENTROPY || (int)n < ru->min_len) continue;
+        if (!checked) {
+            e = entropy_bits((const unsigned char*)s + start, n);
+            checked = 1;
+        }
+        if (e >= ru->bits) add_hit(d, r, start, end);
+    }
+}
+
+static void on_whole(detect_ctx *d, const char *s, size_t start, size_t end, unsigned classes) {
+    size_t n = end - start;
+    if ((classes & (C_ALNUM | C_SYMBOL)) != (C_ALNUM | C_SYMBOL)) return;
+    /* code and paths, not passwords */
+    for (size_t i = start; i < end; ++i)
+        if (strchr("()[]{};<>/\\", s[i])) return;
+    for (int r = 0; r < g_nrules; ++r) {
+        const rule *ru = &g_rules[r];
+        if (ru->kind == R_PASSWORD && (int)n >= ru->min_len && (int)n <= ru->max_len)
+            add_hit(d, r, start, end);
+    }
+}
+
+static void detect(const char *s, size_t len, detect_ctx *d) {
+    const unsigned long long FNV_OFFSET = 1469598103934665603ULL;
+    const unsigned long long FNV_PRIME  = 1099511628211ULL;
+    unsigned long long h = FNV_OFFSET;
+    int scan = g_action != CHUB_SECRET_OFF && g_delta;
+    unsigned st = 0;
+    size_t tok_start = 0;        /* current run of token bytes */
+    unsigned classes = 0, all_classes = 0;
+    size_t first = len, last = 0;  /* non-whitespace bounds */
+    int split = 0;               /* whitespace between first and last */
+
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        h ^= c;
+        h *= FNV_PRIME;
+        if (!scan) continue;
+        st = g_delta[st * 256 + c];
+        if (g_out[st]) on_literals(d, s, len, i, g_out[st]);
+        unsigned k = g_cls[c];
+        if (k & C_TOKEN) {
+            classes |= k;
+        } else {
+            if (i > tok_start) on_token(d, s, tok_start, i, classes);
+            tok_start = i + 1;
+            classes = 0;
+        }
+        if (k) {
+            if (first == len) first = i;
+            else if (last < i) split = 1;
+            last = i + 1;
+            all_classes |= k;
+        }
+    }
+    if (scan && len > tok_start) on_token(d, s, tok_start, len, classes);
+    if (scan && !split && first < last) on_whole(d, s, first, last, all_classes);
+    d->res->h = h;
+    d->res->drop = d->res->hits > 0 && g_action == CHUB_SECRET_DROP;
+}
+
+void chub_secret_scan(const char *s, size_t len, chub_secret_result *res) {
+    memset(res, 0, sizeof(*res));
+    detect_ctx d = { res, 0, NULL, 0, 0, 0 };
+    detect(s ? s : "", s ? len : 0, &d);
+}
+
+static int cmp_spans(const void *a, const void *b) {
+    const span *x = (const span*)a, *y = (const span*)b;
+    return x->start < y->start ? -1 : x->start > y->start ? 1 : 0;
+}
+
+int chub_secret_redact(char *s, size_t buf_sz) {
+    if (!s || buf_sz == 0) return 1;
+    size_t len = strlen(s);
+    chub_secret_result res;
+    memset(&res, 0, sizeof(res));
+    detect_ctx d = { &res, 1, NULL, 0, 0, 0 };
+    detect(s, len, &d);
+    span *spans = d.spans;
+    if (d.oom) { free(spans); return 4; }
+    if (d.nspans == 0) return 0;
+    qsort(spans, (size_t)d.nspans, sizeof(span), cmp_spans);
+
+    const size_t rlen = sizeof(REDACTED) - 1;
+    char *out = (char*)malloc(len + (size_t)d.nspans * rlen + 1);
+    if (!out) { free(spans); return 4; }
+    size_t w = 0, r = 0;
+    for (int i = 0; i < d.nspans; ++i) {
+        if (spans[i].end <= r) continue;  /* inside a span already redacted */
+        size_t start = spans[i].start > r ? spans[i].start : r;
+        memcpy(out + w, s + r, start - r); w += start - r;
+        if (start == spans[i].start) { memcpy(out + w, REDACTED, rlen); w += rlen; }
+        r = spans[i].end;
+    }
+    memcpy(out + w, s + r, len - r); w += len - r;
+    if (w >= buf_sz) w = buf_sz - 1;
+    memcpy(s, out, w);
+    s[w] = '\0';
+    free(out);
+    free(spans);
+    return 0;
+}
+
+void chub_secret_record(const chub_secret_result *res) {
+    unsigned long long m = res->rule_mask;
+    for (int r = 0; m && r < g_nrules; ++r, m >>= 1)
+        if (m & 1) InterlockedIncrement(&g_hits[r]);
+}
+
+int chub_secret_rule_count(void) { return g_nrules; }
+const char *chub_secret_rule_name(int i) { return g_rules[i].name; }
+long chub_secret_rule_hits(int i) { return (long)InterlockedCompareExchange(&g_hits[i], 0, 0); }
@@ -0,0 +1,146 @@
+#include "chub/snapshot.h"
+#include "chub/util.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* layout: header | rec[count] | blob (previews, each NUL-terminated) */
+
+#define SNAP_MAGIC   "CHUBSNAP"
+#define SNAP_VERSION 1u
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int count;
+    unsigned long long blob_size;
+    long long written_ts;
+} snap_header;
+
+typedef struct {
+    long long ts;
+    unsigned long long h;
+    int id;
+    int favorite;
+    unsigned int off;   /* into blob */
+    unsigned int len;   /* preview bytes, excluding NUL */
+} snap_rec;
+
+static HANDLE g_file = INVALID_HANDLE_VALUE;
+static HANDLE g_map  = NULL;
+static const unsigned char *g_view = NULL;
+static const snap_header *g_hdr = NULL;
+
+/* 0 if the header matches and every record fits in the file with its
+   preview NUL-terminated inside the blob */
+static int validate(const unsigned char *base, unsigned long long size) {
+    if (size < sizeof(snap_header)) return 1;
+    const snap_header *hd = (const snap_header*)base;
+    if (memcmp(hd->magic, SNAP_MAGIC, 8) != 0 || hd->version != SNAP_VERSION) return 2;
+    unsigned long long need = sizeof(snap_header)
+                            + (unsigned long long)hd->count * sizeof(snap_rec)
+                            + hd->blob_size;
+    if (need > size) return 3;
+    const snap_rec *rec = (const snap_rec*)(base + sizeof(snap_header));
+    const char *blob = (const char*)(rec + hd->count);
+    for (unsigned int i = 0; i < hd->count; ++i) {
+        unsigned long long end = (unsigned long long)rec[i].off + rec[i].len;
+        if (end >= hd->blob_size || blob[end] != '\0') return 4;
+    }
+    return 0;
+}
+
+int chub_snapshot_open(const char *path) {
+    if (g_view) return 0;
+    if (!path) return 1;
+    g_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_file == INVALID_HANDLE_VALUE) return 1;
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(g_file, &sz) || sz.QuadPart < (LONGLONG)sizeof(snap_header)) {
+        chub_snapshot_close();
+        return 2;
+    }
+    g_map = CreateFileMappingA(g_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!g_map) { chub_snapshot_close(); return 3; }
+    g_view = (const unsigned char*)MapViewOfFile(g_map, FILE_MAP_READ, 0, 0, 0);
+    if (!g_view) { chub_snapshot_close(); return 3; }
+    if (validate(g_view, (unsigned long long)sz.QuadPart) != 0) {
+        chub_snapshot_close();
+        return 4;
+    }
+    g_hdr = (const snap_header*)g_view;
+    return 0;
+}
+
+void chub_snapshot_close(void) {
+    if (g_view) UnmapViewOfFile(g_view);
+    if (g_map) CloseHandle(g_map);
+    if (g_file != INVALID_HANDLE_VALUE) CloseHandle(g_file);
+    g_view = NULL; g_map = NULL; g_file = INVALID_HANDLE_VALUE; g_hdr = NULL;
+}
+
+int chub_snapshot_load(chub_resultset **out) {
+    if (!out) return 1;
+    *out = NULL;
+    if (!g_hdr) return 2;
+    const snap_rec *rec = (const snap_rec*)(g_view + sizeof(snap_header));
+    const char *blob = (const char*)(rec + g_hdr->count);
+    chub_resultset *rs = chub_rs_new();
+    if (!rs) return 3;
+    for (unsigned int i = 0; i < g_hdr->count; ++i) {
+        if (chub_rs_push(rs, rec[i].id, rec[i].ts, rec[i].favorite, rec[i].h,
+                         blob + rec[i].off, rec[i].len) != 0) {
+            chub_rs_free(rs);
+            return 3;
+        }
+    }
+    *out = rs;
+    return 0;
+}
+
+int chub_snapshot_write(const char *path, const chub_resultset *rs) {
+    if (!path || !rs) return 1;
+    int count = chub_rs_count(rs);
+    char tmp[MAX_PATH * 4];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 1;
+
+    snap_rec *rec = count ? (snap_rec*)calloc((size_t)count, sizeof(snap_rec)) : NULL;
+    if (count && !rec) return 2;
+    unsigned long long blob_size = 0;
+    for (int i = 0; i < count; ++i) {
+        size_t len = chub_utf8_clip(chub_rs_text(rs, i), chub_rs_length(rs, i), CHUB_SNAPSHOT_PREVIEW_MAX);
+        rec[i].ts       = chub_rs_ts(rs, i);
+        rec[i].h        = chub_rs_hash(rs, i);
+        rec[i].id       = chub_rs_id(rs, i);
+        rec[i].favorite = chub_rs_favorite(rs, i);
+        rec[i].off      = (unsigned int)blob_size;
+        rec[i].len      = (unsigned int)len;
+        blob_size += len + 1;
+    }
+
+    snap_header hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, SNAP_MAGIC, 8);
+    hd.version = SNAP_VERSION;
+    hd.count = (unsigned int)count;
+    hd.blob_size = blob_size;
+    hd.written_ts = chub_now_millis();
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { free(rec); return 3; }
+    int ok = fwrite(&hd, sizeof(hd), 1, f) == 1;
+    if (ok && count) ok = fwrite(rec, sizeof(snap_rec), (size_t)count, f) == (size_t)count;
+    for (int i = 0; ok && i < count; ++i) {
+        ok = fwrite(chub_rs_text(rs, i), 1, rec[i].len, f) == rec[i].len && fputc('\0', f) != EOF;
+    }
+    free(rec);
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) { DeleteFileA(tmp); return 4; }
+    if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileA(tmp);
+        return 5;
+    }
+    return 0;
+}
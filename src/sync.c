@@ -0,0 +1,381 @@
+#include "chub/sync.h"
+#include "chub/util.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* segment layout: header | records, each a seg_rec followed by its text.
+   Files are written to a tmp name and renamed, and never change after
+   that; compaction writes a new one and deletes those it replaces. */
+
+#define SEG_MAGIC    "CHUBSEG1"
+#define SEG_VERSION  1u
+#define SEG_NAME_LEN 37   /* %016llx-%016llx.seg */
+
+typedef struct {
+    char magic[8];
+    unsigned int version;
+    unsigned int count;
+    long long first_seq;
+    long long last_seq;
+    unsigned long long body_hash;  /* FNV-1a of the records: catches partial copies */
+    char node[24];
+} seg_header;
+
+typedef struct {
+    long long seq;
+    long long hlc;
+    long long ts;
+    unsigned long long h;
+    int op;
+    int arg;
+    unsigned int kind;
+    unsigned int len;   /* text bytes that follow */
+} seg_rec;
+
+typedef struct {
+    long long first, last;
+    char name[SEG_NAME_LEN + 1];
+} seg_file;
+
+static unsigned long long fnv_update(unsigned long long h, const void *p, size_t n) {
+    const unsigned char *s = (const unsigned char*)p;
+    for (size_t i = 0; i < n; ++i) { h ^= s[i]; h *= 1099511628211ULL; }
+    return h;
+}
+
+static int is_node_name(const char *s) {
+    size_t n = 0;
+    for (; s[n]; ++n)
+        if (!((s[n] >= '0' && s[n] <= '9') || (s[n] >= 'a' && s[n] <= 'f'))) return 0;
+    return n == CHUB_SYNC_NODE_LEN;
+}
+
+/* ----- segment files ----- */
+
+/* inserts whose entry was gone before export are left out; the name still
+   spans first..last so peers move past them. *written: records kept */
+static int write_segment(const char *dir, const char *node, const chub_change *arr, int n,
+                         long long first, long long last, int *written) {
+    *written = 0;
+    int keep = 0;
+    for (int i = 0; i < n; ++i) keep += arr[i].op != CHUB_CHANGE_INSERT || arr[i].text;
+    if (!keep) return 0;
+
+    char name[SEG_NAME_LEN + 1], path[MAX_PATH * 4], tmp[MAX_PATH * 4];
+    snprintf(name, sizeof(name), "%016llx-%016llx.seg", (unsigned long long)first, (unsigned long long)last);
+    if (chub_path_join(dir, name, path, sizeof(path)) != 0 ||
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return 1;
+
+    seg_header hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, SEG_MAGIC, 8);
+    hd.version = SEG_VERSION;
+    hd.first_seq = first;
+    hd.last_seq = last;
+    snprintf(hd.node, sizeof(hd.node), "%s", node);
+    hd.body_hash = 1469598103934665603ULL;
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return 3;
+    int ok = fwrite(&hd, sizeof(hd), 1, f) == 1;  /* rewritten once count and hash are known */
+    for (int i = 0; ok && i < n; ++i) {
+        const chub_change *c = &arr[i];
+        if (c->op == CHUB_CHANGE_INSERT && !c->text) continue;
+        seg_rec r;
+        memset(&r, 0, sizeof(r));
+        r.seq = c->seq; r.hlc = c->hlc; r.ts = c->ts; r.h = c->h;
+        r.op = c->op; r.arg = c->arg; r.kind = c->kind;
+        r.len = c->text ? (unsigned int)c->len : 0;
+        ok = fwrite(&r, sizeof(r), 1, f) == 1 && (!r.len || fwrite(c->text, 1, r.len, f) == r.len);
+        hd.body_hash = fnv_update(hd.body_hash, &r, sizeof(r));
+        if (r.len) hd.body_hash = fnv_update(hd.body_hash, c->text, r.len);
+        hd.count++;
+    }
+    if (ok) ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(&hd, sizeof(hd), 1, f) == 1;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) { DeleteFileA(tmp); return 3; }
+    if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileA(tmp);
+        return 3;
+    }
+    *written = (int)hd.count;
+    return 0;
+}
+
+/* whole file into changes (texts malloc'd, NUL-terminated). 2 if it is
+   truncated, corrupt or from another instance than its folder says */
+static int read_segment(const char *path, const char *node, chub_change **out, int *out_count) {
+    *out = NULL;
+    *out_count = 0;
+    FILE *f = fopen(path, "rb");
+    if (!f) return 3;
+    unsigned char *buf = NULL;
+    long size = -1;
+    if (fseek(f, 0, SEEK_END) == 0) size = ftell(f);
+    if (size >= 0 && fseek(f, 0, SEEK_SET) == 0 && (buf = (unsigned char*)malloc((size_t)size + 1)) != NULL &&
+        fread(buf, 1, (size_t)size, f) != (size_t)size) size = -1;
+    fclose(f);
+    if (size < 0 || !buf) { free(buf); return 3; }
+
+    seg_header hd;
+    if ((size_t)size < sizeof(hd)) { free(buf); return 2; }
+    memcpy(&hd, buf, sizeof(hd));
+    hd.node[sizeof(hd.node) - 1] = '\0';
+    const unsigned char *p = buf + sizeof(hd), *end = buf + size;
+    if (memcmp(hd.magic, SEG_MAGIC, 8) != 0 || hd.version != SEG_VERSION || strcmp(hd.node, node) != 0 ||
+        fnv_update(1469598103934665603ULL, p, (size_t)(end - p)) != hd.body_hash ||
+        hd.count > (size_t)(end - p) / sizeof(seg_rec)) {
+        free(buf);
+        return 2;
+    }
+    chub_change *arr = hd.count ? (chub_change*)calloc(hd.count, sizeof(chub_change)) : NULL;
+    if (hd.count && !arr) { free(buf); return 4; }
+    int rc = 0;
+    unsigned n = 0;
+    while (rc == 0 && n < hd.count) {
+        seg_rec r;
+        if ((size_t)(end - p) < sizeof(r)) { rc = 2; break; }
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+        if (r.len > (size_t)(end - p) || r.seq < hd.first_seq || r.seq > hd.last_seq ||
+            (r.op == CHUB_CHANGE_INSERT && (!r.len || memchr(p, 0, r.len)))) { rc = 2; break; }
+        chub_change *c = &arr[n];
+        c->seq = r.seq; c->hlc = r.hlc; c->ts = r.ts; c->h = r.h;
+        c->op = r.op; c->arg = r.arg; c->kind = r.kind;
+        if (r.len) {
+            if (!(c->text = (char*)malloc(r.len + 1))) { rc = 4; break; }
+            memcpy(c->text, p, r.len);
+            c->text[r.len] = '\0';
+            c->len = r.len;
+            p += r.len;
+        }
+        n++;
+    }
+    if (rc == 0 && p != end) rc = 2;
+    free(buf);
+    if (rc != 0) { chub_db_free_changes(arr, (int)n); return rc; }
+    *out = arr;
+    *out_count = (int)n;
+    return 0;
+}
+
+static int cmp_seg(const void *a, const void *b) {
+    long long x = ((const seg_file*)a)->first, y = ((const seg_file*)b)->first;
+    return x < y ? -1 : x > y;
+}
+
+/* segments in dir, oldest first */
+static int list_segments(const char *dir, seg_file **out, int *out_count) {
+    *out = NULL;
+    *out_count = 0;
+    char pattern[MAX_PATH * 4];
+    if (chub_path_join(dir, "*.seg", pattern, sizeof(pattern)) != 0) return 1;
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    seg_file *arr = NULL;
+    int n = 0, cap = 0, rc = 0;
+    do {
+        seg_file s;
+        /* the pattern also matches longer extensions, e.g. our .seg.tmp */
+        if (strlen(fd.cFileName) != SEG_NAME_LEN ||
+            sscanf(fd.cFileName, "%16llx-%16llx.seg", (unsigned long long*)&s.first,
+                   (unsigned long long*)&s.last) != 2 || s.last < s.first) continue;
+        if (n == cap) {
+            int ncap = cap ? cap * 2 : 16;
+            seg_file *na = (seg_file*)realloc(arr, (size_t)ncap * sizeof(seg_file));
+            if (!na) { rc = 4; break; }
+            arr = na; cap = ncap;
+        }
+        snprintf(s.name, sizeof(s.name), "%s", fd.cFileName);
+        arr[n++] = s;
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    if (rc != 0) { free(arr); return rc; }
+    if (n > 1) qsort(arr, (size_t)n, sizeof(seg_file), cmp_seg);
+    *out = arr;
+    *out_count = n;
+    return 0;
+}
+
+/* ----- sync steps ----- */
+
+static int export_changes(const char *own, chub_sync_report *r, long long exported) {
+    for (;;) {
+        chub_change *arr = NULL;
+        int n = 0, written = 0;
+        int rc = chub_db_changes_since(exported, CHUB_SYNC_SEGMENT_CHANGES, &arr, &n);
+        if (rc != 0) return rc;
+        if (n == 0) { chub_db_free_changes(arr, 0); return 0; }
+        long long last = arr[n - 1].seq;
+        rc = write_segment(own, r->node, arr, n, arr[0].seq, last, &written);
+        chub_db_free_changes(arr, n);
+        /* a crash before this rewrites the same file next run; peers skip
+           what they've merged */
+        if (rc == 0) rc = chub_db_changes_exported(last);
+        if (rc != 0) return rc;
+        if (written) { r->exported += written; r->segments_written++; }
+        exported = last;
+    }
+}
+
+/* new segments of one peer, in order. A bad segment stops at that peer:
+   merging the ones after it would move its seq past the gap */
+static int merge_peer(const char *dir, const char *peer, chub_sync_report *r) {
+    seg_file *segs = NULL;
+    int nsegs = 0;
+    int rc = list_segments(dir, &segs, &nsegs);
+    if (rc != 0) return rc;
+    long long done = chub_db_peer_seq(peer);
+    for (int i = 0; rc == 0 && i < nsegs; ++i) {
+        if (segs[i].last <= done) continue;
+        char path[MAX_PATH * 4];
+        chub_change *arr = NULL;
+        int n = 0, applied = 0;
+        if (chub_path_join(dir, segs[i].name, path, sizeof(path)) != 0) { rc = 1; break; }
+        int rrc = read_segment(path, peer, &arr, &n);
+        if (rrc != 0) {
+            chub_log("WARN", "sync: skipping %s from %s (%s)", segs[i].name, peer,
+                     rrc == 2 ? "incomplete or corrupt" : "unreadable");
+            break;
+        }
+        rc = chub_db_apply_changes(peer, arr, n, segs[i].last, &applied);
+        chub_db_free_changes(arr, n);
+        r->segments_read++;
+        r->changes_read += n;
+        r->applied += applied;
+    }
+    free(segs);
+    return rc;
+}
+
+static int merge_peers(const char *dir, chub_sync_report *r) {
+    char pattern[MAX_PATH * 4];
+    if (chub_path_join(dir, "*", pattern, sizeof(pattern)) != 0) return 1;
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) return 0;
+    int rc = 0;
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !is_node_name(fd.cFileName) ||
+            strcmp(fd.cFileName, r->node) == 0) continue;
+        char sub[MAX_PATH * 4];
+        if (chub_path_join(dir, fd.cFileName, sub, sizeof(sub)) != 0) continue;
+        r->peers++;
+        rc = merge_peer(sub, fd.cFileName, r);
+    } while (rc == 0 && FindNextFileA(h, &fd));
+    FindClose(h);
+    return rc;
+}
+
+/* by content hash, newest clock first */
+static int cmp_supersede(const void *a, const void *b) {
+    const chub_change *x = *(const chub_change* const*)a, *y = *(const chub_change* const*)b;
+    if (x->h != y->h) return x->h < y->h ? -1 : 1;
+    return x->hlc > y->hlc ? -1 : x->hlc < y->hlc;
+}
+
+/* per content hash only the newest insert, favorite and delete matter, and
+   an insert older than the delete not even that; keep[] marks the rest */
+static void mark_live(chub_change *all, int n, char *keep) {
+    const chub_change **by = (const chub_change**)malloc((size_t)n * sizeof(*by));
+    if (!by) { memset(keep, 1, (size_t)n); return; }
+    for (int i = 0; i < n; ++i) by[i] = &all[i];
+    qsort(by, (size_t)n, sizeof(*by), cmp_supersede);
+    for (int g = 0; g < n;) {
+        int e = g;
+        long long del = 0;
+        while (e < n && by[e]->h == by[g]->h) {
+            if (by[e]->op != CHUB_CHANGE_INSERT && by[e]->op != CHUB_CHANGE_FAVORITE && !del) del = by[e]->hlc;
+            ++e;
+        }
+        int ins = 0, fav = 0, dels = 0;
+        for (int i = g; i < e; ++i) {
+            const chub_change *c = by[i];
+            int live;
+            if (c->op == CHUB_CHANGE_INSERT)        live = !ins++ && c->hlc > del;
+            else if (c->op == CHUB_CHANGE_FAVORITE) live = !fav++;
+            else                                    live = !dels++;
+            keep[c - all] = (char)live;
+        }
+        g = e;
+    }
+    free(by);
+}
+
+/* fold our segments into one once there are many. Peers that merged part
+   of the range skip it by seq, so they see no difference. A segment that
+   can't be read is left alone, with a warning, rather than failing the run. */
+static int compact(const char *own, chub_sync_report *r) {
+    seg_file *segs = NULL;
+    int nsegs = 0;
+    int rc = list_segments(own, &segs, &nsegs);
+    if (rc != 0 || nsegs <= CHUB_SYNC_COMPACT_SEGMENTS) { free(segs); return rc; }
+
+    chub_change *all = NULL;
+    int total = 0;
+    for (int i = 0; rc == 0 && i < nsegs; ++i) {
+        char path[MAX_PATH * 4];
+        chub_change *arr = NULL;
+        int n = 0;
+        if (chub_path_join(own, segs[i].name, path, sizeof(path)) != 0) rc = 1;
+        if (rc == 0) rc = read_segment(path, r->node, &arr, &n);
+        if (rc == 2 || rc == 3) {
+            chub_log("WARN", "sync: not compacting, %s is %s", segs[i].name,
+                     rc == 2 ? "incomplete or corrupt" : "unreadable");
+            chub_db_free_changes(all, total);
+            free(segs);
+            return 0;
+        }
+        if (rc == 0 && n) {
+            chub_change *na = (chub_change*)realloc(all, (size_t)(total + n) * sizeof(chub_change));
+            if (!na) { chub_db_free_changes(arr, n); rc = 4; break; }
+            all = na;
+            memcpy(all + total, arr, (size_t)n * sizeof(chub_change));  /* texts move over */
+            total += n;
+            free(arr);
+        }
+    }
+    char *keep = rc == 0 && total ? (char*)malloc((size_t)total) : NULL;
+    if (rc == 0 && total && !keep) rc = 4;
+    if (rc == 0) {
+        int k = 0, written = 0;
+        if (total) mark_live(all, total, keep);
+        for (int i = 0; i < total; ++i) {
+            if (keep[i]) all[k++] = all[i];
+            else free(all[i].text);
+        }
+        r->dropped = total - k;
+        total = k;
+        rc = write_segment(own, r->node, all, total, segs[0].first, segs[nsegs - 1].last, &written);
+    }
+    if (rc == 0) {
+        /* the new file is in place (and sorts first), so these are redundant */
+        for (int i = 0; i < nsegs; ++i) {
+            char path[MAX_PATH * 4];
+            if (segs[i].first == segs[0].first && segs[i].last == segs[nsegs - 1].last) continue;
+            if (chub_path_join(own, segs[i].name, path, sizeof(path)) == 0) DeleteFileA(path);
+        }
+        r->compacted = nsegs;
+    }
+    chub_db_free_changes(all, total);
+    free(keep);
+    free(segs);
+    return rc;
+}
+
+int chub_sync_run(const char *dir, chub_sync_report *out) {
+    if (!dir || !*dir || !out) return 1;
+    memset(out, 0, sizeof(*out));
+    long long exported = 0;
+    int rc = chub_db_sync_enable(out->node, &exported);
+    if (rc != 0) return rc;
+    char own[MAX_PATH * 4];
+    if (chub_path_join(dir, out->node, own, sizeof(own)) != 0 || chub_mkdir_p(own) != 0) return 3;
+    rc = export_changes(own, out, exported);
+    if (rc == 0) rc = merge_peers(dir, out);
+    if (rc == 0) rc = compact(own, out);
+    return rc;
+}
@@ -1,11 +1,16 @@
 #include "chub/tui.h"
+#include "chub/classify.h"
 #include "chub/db.h"
 #include "chub/clip.h"
+#include "chub/regex.h"
+#include "chub/scan.h"
+#include "chub/snapshot.h"
 #include "chub/transform.h"
 #include "chub/util.h"
 
 #include <ncursesw/curses.h>  // wide-capable library, but we'll print via UTF-8 multibyte APIs
 #include <locale.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <wchar.h>
@@ -14,24 +19,121 @@
 #define MAX_LIST 500
 #define SEARCH_BUF 256
 
-static chub_item *g_items = NULL;
+static chub_resultset *g_items = NULL;
 static int g_count = 0;
 static int g_sel = 0;
 static int g_scroll = 0;
 static char g_search[SEARCH_BUF] = {0};
 static volatile LONG g_needs_refresh = 1;
+static volatile LONG g_quit = 0;
+static int g_from_snapshot = 0;  /* items are snapshot previews; read-only */
+static int g_rank = 0;           /* 'r': favorites + frecency instead of newest first */
+static char g_flash[128];  /* transient status message */
+static long long g_flash_until = 0;
+
+#define FLASH_MS 1500
+#define REGEX_PREFIX "re:"
+#define FUZZY_PREFIX "~"
+#define SEARCH_BUDGET_MS 2000
+
+static void show_message(const char *msg) {
+    snprintf(g_flash, sizeof(g_flash), "%s", msg);
+    g_flash_until = chub_now_millis() + FLASH_MS;
+}
+
+/* searches run on the parallel scan pool (or the kind index when the term
+   starts with type:/size: facets); the single-connection queries are the
+   fallback when the pool couldn't start */
+static void run_search(chub_resultset **rs) {
+    char err[96], msg[128];
+    chub_scan_query q;
+    memset(&q, 0, sizeof(q));
+    q.limit = MAX_LIST;
+    q.budget_ms = SEARCH_BUDGET_MS;
+    q.order = g_rank ? CHUB_SCAN_BY_FRECENCY : CHUB_SCAN_BY_TS;
+    chub_regex *re = NULL;
+    chub_facets facets;
+    const char *term = g_search;
+    if (chub_facets_parse(g_search, &facets, &term, err, sizeof(err)) != 0) {
+        show_message(err);
+        return;
+    }
+    q.facets = &facets;
+    if (!term[0] && facets.n > 0) {
+        q.match = NULL;  /* facets only */
+    } else if (strncmp(term, REGEX_PREFIX, strlen(REGEX_PREFIX)) == 0) {
+        term += strlen(REGEX_PREFIX);
+        if (chub_regex_compile(term, &re, err, sizeof(err)) != 0) {
+            snprintf(msg, sizeof(msg), "bad regex: %s", err);
+            show_message(msg);
+            return;
+        }
+        q.match = chub_scan_match_regex; q.ctx = re;
+    } else if (strncmp(term, FUZZY_PREFIX, strlen(FUZZY_PREFIX)) == 0) {
+        term += strlen(FUZZY_PREFIX);
+        q.match = chub_scan_match_fuzzy; q.ctx = (void*)term;
+        q.order = CHUB_SCAN_BY_SCORE;
+    } else {
+        q.match = chub_scan_match_substring; q.ctx = (void*)term;
+    }
+
+    int rc = chub_scan_run(&q, rs);
+    if (rc == 1) {
+        if (re) rc = chub_db_search_regex(term, MAX_LIST, SEARCH_BUDGET_MS, rs, err, sizeof(err));
+        else    rc = chub_db_search_rs(term, MAX_LIST, rs);
+    }
+    chub_regex_free(re);
+    if (rc == 5) show_message("search over time budget; showing partial results");
+}
+
+/* list rows carry previews; the full text is read only for the selection.
+   Dropped with the list: ids are reused once the newest row is deleted */
+static int g_full_id = -1;
+static char *g_full = NULL;
+
+static const char *selected_text(void) {
+    if (g_sel < 0 || g_sel >= g_count) return NULL;
+    if (g_from_snapshot || !chub_rs_is_preview(g_items, g_sel)) return chub_rs_text(g_items, g_sel);
+    int id = chub_rs_id(g_items, g_sel);
+    if (id != g_full_id) {
+        free(g_full);
+        g_full = NULL;
+        g_full_id = chub_db_fetch_text(id, &g_full, NULL) == 0 ? id : -1;
+    }
+    return g_full ? g_full : chub_rs_text(g_items, g_sel);
+}
 
 static void free_items(void) {
-    chub_db_free_items(g_items, g_count);
+    chub_rs_free(g_items);
     g_items = NULL; g_count = 0; g_sel = 0; g_scroll = 0;
+    g_from_snapshot = 0;
+    free(g_full);
+    g_full = NULL; g_full_id = -1;
 }
 
 static void load_items(void) {
-    chub_item *arr = NULL; int n = 0;
-    if (g_search[0]) chub_db_search(g_search, MAX_LIST, &arr, &n);
-    else             chub_db_fetch_recent(MAX_LIST, &arr, &n);
+    chub_resultset *rs = NULL;
+    if (!chub_db_ready()) {
+        /* DB still opening: paint the snapshot once and wait for a refresh */
+        if (g_from_snapshot || g_items) return;
+        int rc = chub_snapshot_load(&rs);
+        chub_snapshot_close();
+        if (rc != 0) return;
+        g_items = rs; g_count = chub_rs_count(rs); g_from_snapshot = 1;
+        return;
+    }
+    /* reconcile: swap snapshot rows for DB rows, keeping the selection */
+    int was_snapshot = g_from_snapshot;
+    int sel_id = (was_snapshot && g_sel < g_count) ? chub_rs_id(g_items, g_sel) : -1;
+    if (g_search[0]) run_search(&rs);
+    else if (g_rank) chub_db_fetch_ranked_rs(MAX_LIST, &rs);
+    else             chub_db_fetch_recent_rs(MAX_LIST, &rs);
     free_items();
-    g_items = arr; g_count = n;
+    g_items = rs; g_count = chub_rs_count(rs);
+    if (sel_id >= 0) {
+        int i = chub_rs_find_id(g_items, sel_id);
+        if (i >= 0) g_sel = i;
+    }
     if (g_sel >= g_count) g_sel = g_count ? g_count - 1 : 0;
     if (g_scroll > g_sel) g_scroll = g_sel;
 }
@@ -93,12 +195,12 @@ static void draw_list(WINDOW *win, int h, int w) {
         if (text_cols < 0) text_cols = 0;
 
         /* first line (until newline) */
-        const char *txt = g_items[i].text ? g_items[i].text : "";
-        const char *nl  = strchr(txt, '\n');
-        int first_len   = (int)(nl ? (nl - txt) : (int)strlen(txt));
+        const char *txt = chub_rs_text(g_items, i);
+        const char *nl  = memchr(txt, '\n', chub_rs_length(g_items, i));
+        int first_len   = (int)(nl ? (size_t)(nl - txt) : chub_rs_length(g_items, i));
 
         if (i == g_sel) wattron(win, A_REVERSE);
-        mvwprintw(win, row+1, 1, "%c %4d ", g_items[i].favorite ? '*' : ' ', g_items[i].id);
+        mvwprintw(win, row+1, 1, "%c %4d ", chub_rs_favorite(g_items, i) ? '*' : ' ', chub_rs_id(g_items, i));
 
         size_t safe = utf8_prefix_by_chars(txt, text_cols);
         if (safe > (size_t)first_len) safe = (size_t)first_len;  /* don't go past first line */
@@ -112,8 +214,8 @@ static void draw_list(WINDOW *win, int h, int w) {
 static void draw_preview(WINDOW *win, int h, int w) {
     werase(win);
     box(win, 0, 0);
-    if (g_sel >= 0 && g_sel < g_count && g_items[g_sel].text) {
-        draw_wrapped_utf8(win, 1, 1, h - 2, w - 2, g_items[g_sel].text);
+    if (g_sel >= 0 && g_sel < g_count) {
+        draw_wrapped_utf8(win, 1, 1, h - 2, w - 2, selected_text());
     } else {
         mvwprintw(win, 1, 1, "(empty)");
     }
@@ -122,10 +224,16 @@ static void draw_preview(WINDOW *win, int h, int w) {
 
 static void draw_status(WINDOW *win, int w) {
     werase(win);
-    mvwprintw(win, 0, 0, "/ search: %s   [Enter] copy  [f] fav  [d] del  [t] transform  [q] quit",
-              g_search[0] ? g_search : "");
+    if (g_from_snapshot) {
+        mvwprintw(win, 0, 0, "loading history...   [q] quit");
+    } else if (g_flash[0] && chub_now_millis() < g_flash_until) {
+        mvwprintw(win, 0, 0, "%s", g_flash);
+    } else {
+        mvwprintw(win, 0, 0, "/ search: %s   [Enter] copy  [f] fav  [d] del  [t] transform  [r] %s  [q] quit",
+                  g_search[0] ? g_search : "", g_rank ? "frecent" : "recent");
+    }
     /* pad remainder */
-    int cur = (int)strlen(g_search) + 11;
+    int cur = getcurx(win);
     for (int i = cur; i < w; ++i) waddch(win, ' ');
     wnoutrefresh(win);
 }
@@ -137,30 +245,46 @@ static void ensure_visible(int h_inner) {
 }
 
 static void do_copy_selected(void) {
-    if (g_sel >= 0 && g_sel < g_count)
-        chub_clip_write(g_items[g_sel].text ? g_items[g_sel].text : "");
+    if (g_from_snapshot) return;  /* previews may be truncated */
+    if (g_sel < 0 || g_sel >= g_count) return;
+    if (chub_clip_write_async(selected_text()) > 0) {
+        chub_db_record_use(chub_rs_id(g_items, g_sel), chub_now_millis());
+        show_message("copying...");
+    } else {
+        show_message("copy failed");
+    }
+}
+
+static void do_toggle_rank(void) {
+    if (g_from_snapshot) return;
+    g_rank = !g_rank;
+    g_sel = 0; g_scroll = 0;
+    load_items();
 }
 
 static void do_toggle_fav_selected(void) {
+    if (g_from_snapshot) return;
     if (g_sel >= 0 && g_sel < g_count) {
-        int id = g_items[g_sel].id;
-        int newf = g_items[g_sel].favorite ? 0 : 1;
+        int id = chub_rs_id(g_items, g_sel);
+        int newf = chub_rs_favorite(g_items, g_sel) ? 0 : 1;
         if (chub_db_mark_favorite(id, newf) == 0)
-            g_items[g_sel].favorite = newf;
+            chub_rs_set_favorite(g_items, g_sel, newf);
     }
 }
 
 static void do_delete_selected(void) {
+    if (g_from_snapshot) return;
     if (g_sel >= 0 && g_sel < g_count) {
-        int id = g_items[g_sel].id;
+        int id = chub_rs_id(g_items, g_sel);
         if (chub_db_delete(id) == 0)
             load_items();
     }
 }
 
 static void do_transform_menu(void) {
-    if (g_sel < 0 || g_sel >= g_count || !g_items[g_sel].text) return;
-    char *tmp = _strdup(g_items[g_sel].text);
+    if (g_from_snapshot) return;
+    if (g_sel < 0 || g_sel >= g_count) return;
+    char *tmp = _strdup(selected_text());
     if (!tmp) return;
     int h; int w; getmaxyx(stdscr, h, w); (void)w;
     mvprintw(h-1, 0, "Transform: [1] Trim  [2] ToggleCase  [3] URL-Decode  [Esc] cancel   ");
@@ -170,11 +294,12 @@ static void do_transform_menu(void) {
     else if (ch == '2') chub_transform_toggle_case(tmp);
     else if (ch == '3') chub_transform_url_decode(tmp);
     else { free(tmp); return; }
-    chub_clip_write(tmp);
+    show_message(chub_clip_write_async(tmp) > 0 ? "copying..." : "copy failed");
     free(tmp);
 }
 
 static void handle_search_input(void) {
+    if (g_from_snapshot) return;
     echo();
     nocbreak();
     curs_set(1);
@@ -209,8 +334,12 @@ int chub_tui_mainloop(void) {
     load_items();
     int running = 1;
     while (running) {
+        if (InterlockedCompareExchange(&g_quit, 0, 0)) break;
         if (InterlockedExchange((volatile LONG*)&g_needs_refresh, 0) != 0)
             load_items();
+        int wseq, wrc;
+        if (chub_clip_writer_poll(&wseq, &wrc))
+            show_message(wrc == 0 ? "copied" : "copy failed");
 
         getmaxyx(stdscr, H, W);
         list_w = W * 2 / 5;
@@ -242,16 +371,22 @@ int chub_tui_mainloop(void) {
             case 'f': do_toggle_fav_selected(); break;
             case 'd': do_delete_selected(); break;
             case 't': do_transform_menu(); break;
+            case 'r': do_toggle_rank(); break;
             case '/': handle_search_input(); break;
             default: break;
         }
     }
 
+    free_items();
     delwin(listw); delwin(prevw); delwin(status);
     endwin();
     return 0;
 }
 
+void chub_tui_request_quit(void) {
+    InterlockedExchange(&g_quit, 1);
+}
+
 /* signal from poller */
 void chub_tui_request_refresh(void) {
     InterlockedExchange((volatile LONG*)&g_needs_refresh, 1);
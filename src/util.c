@@ -28,6 +28,13 @@ unsigned long long chub_hash64(const char *s) {
     return h;
 }
 
+size_t chub_utf8_clip(const char *s, size_t len, size_t max) {
+    if (len <= max) return len;
+    size_t n = max;
+    while (n > 0 && ((unsigned char)s[n] & 0xC0) == 0x80) n--;
+    return n;
+}
+
 long long chub_now_millis(void) {
     /* Windows epoch: use FILETIME -> Unix epoch */
     FILETIME ft;
@@ -43,6 +50,15 @@ long long chub_now_millis(void) {
     return (long long)(unix100ns / 10000ULL);
 }
 
+long long chub_now_micros(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / freq.QuadPart * 1000000 +
+           now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+}
+
 static int _mkdir_one(const char *path) {
     if (_mkdir(path) == 0) return 0;
     if (errno == EEXIST)   return 0;
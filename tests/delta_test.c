@@ -0,0 +1,193 @@
+/* The delta codec on its own (round-trips, truncated and corrupt input),
+   then delta-stored entries in a database, including deleting a base
+   that others are stored against. */
+#include "test_util.h"
+#include "chub/db.h"
+#include "chub/delta.h"
+#include "chub/resultset.h"
+
+static unsigned g_seed = 12345;
+
+static unsigned next_rand(void) {
+    g_seed = g_seed * 1103515245u + 12345u;
+    return g_seed >> 16;
+}
+
+/* len bytes of word-like text, NUL-terminated */
+static char *make_text(size_t len) {
+    static const char *words[] = { "clip", "board", "hub", "entry", "sync", "delta", "base", "text " };
+    char *s = (char*)malloc(len + 1);
+    CHECK(s);
+    size_t w = 0;
+    while (w < len) {
+        const char *wd = words[next_rand() % 8];
+        for (size_t k = 0; wd[k] && w < len; ++k) s[w++] = wd[k];
+        if (w < len) s[w++] = ' ';
+    }
+    s[len] = '\0';
+    return s;
+}
+
+/* base with the cut bytes at `at` replaced by ins */
+static char *edit(const char *base, size_t at, size_t cut, const char *ins) {
+    size_t blen = strlen(base), n = strlen(ins);
+    char *s = (char*)malloc(blen - cut + n + 1);
+    CHECK(s);
+    memcpy(s, base, at);
+    memcpy(s + at, ins, n);
+    strcpy(s + at + n, base + at + cut);
+    return s;
+}
+
+static void round_trip(const char *base, const char *target) {
+    size_t blen = strlen(base), tlen = strlen(target), dlen = 0, olen = 0;
+    unsigned char *d = NULL;
+    char *out = NULL;
+    CHECK(chub_delta_encode(base, blen, target, tlen, &d, &dlen) == 0);
+    CHECK(chub_delta_apply(base, blen, d, dlen, &out, &olen) == 0);
+    CHECK(olen == tlen && memcmp(out, target, tlen) == 0 && out[olen] == '\0');
+    free(out);
+
+    /* every proper prefix is rejected, not read past */
+    for (size_t k = 0; k < dlen; ++k) {
+        out = NULL;
+        CHECK(chub_delta_apply(base, blen, d, k, &out, &olen) == 2 && !out);
+    }
+    free(d);
+}
+
+static void codec(void) {
+    char *base = make_text(2000);
+    char *near = edit(base, 900, 5, "CHANGED");
+    char *front = edit(base, 0, 0, "prefix added ");
+    char *back = edit(base, 2000, 0, " and a tail");
+    char *moved = edit(base + 1000, 1000, 0, base);  /* second half, then all of it */
+
+    round_trip(base, base);
+    round_trip(base, near);
+    round_trip(base, front);
+    round_trip(base, back);
+    round_trip(base, moved);
+    round_trip(base, "short");
+    round_trip(base, "");
+    round_trip("", near);
+    round_trip("tiny", "tinier");
+
+    size_t blen = strlen(base), nlen = strlen(near), dlen = 0, olen = 0;
+    unsigned char *d = NULL;
+    char *out = NULL;
+    CHECK(chub_delta_encode(base, blen, near, nlen, &d, &dlen) == 0);
+
+    /* corrupt: wrong magic, an op past the claimed length, a base too short
+       for its copies */
+    unsigned char *bad = (unsigned char*)malloc(dlen + 2);
+    CHECK(bad);
+    memcpy(bad, d, dlen);
+    bad[0] ^= 0xFF;
+    CHECK(chub_delta_apply(base, blen, bad, dlen, &out, &olen) == 2);
+    memcpy(bad, d, dlen);
+    bad[dlen] = 1 << 1;  /* ADD 1 */
+    bad[dlen + 1] = 'x';
+    CHECK(chub_delta_apply(base, blen, bad, dlen + 2, &out, &olen) == 2);
+    CHECK(chub_delta_apply(base, blen / 2, d, dlen, &out, &olen) == 2);
+    /* a claimed length that the ops don't add up to */
+    memcpy(bad, d, dlen);
+    bad[1] ^= 0x01;
+    CHECK(chub_delta_apply(base, blen, bad, dlen, &out, &olen) == 2);
+    /* an absurd claimed length */
+    static const unsigned char huge[] = { 'D', 0xFF, 0xFF, 0xFF, 0xFF, 0x7F };
+    CHECK(chub_delta_apply(base, blen, huge, sizeof(huge), &out, &olen) == 2);
+
+    /* random damage either fails cleanly or yields text of the claimed length */
+    for (int trial = 0; trial < 2000; ++trial) {
+        memcpy(bad, d, dlen);
+        int flips = 1 + (int)(next_rand() % 4);
+        for (int f = 0; f < flips; ++f) bad[next_rand() % dlen] ^= (unsigned char)(1 + next_rand() % 255);
+        out = NULL;
+        int rc = chub_delta_apply(base, blen, bad, dlen, &out, &olen);
+        CHECK(rc == 0 || rc == 2 || rc == 4);
+        if (rc == 0) CHECK(out && out[olen] == '\0');
+        else CHECK(!out);
+        free(out);
+    }
+    free(bad);
+    free(d);
+    free(base); free(near); free(front); free(back); free(moved);
+}
+
+static int newest_id(void) {
+    chub_resultset *rs = NULL;
+    CHECK(chub_db_fetch_recent_rs(1, &rs) == 0 && chub_rs_count(rs) == 1);
+    int id = chub_rs_id(rs, 0);
+    chub_rs_free(rs);
+    return id;
+}
+
+static void check_text(int id, const char *want) {
+    char *got = NULL;
+    size_t len = 0;
+    CHECK(chub_db_fetch_text(id, &got, &len) == 0);
+    CHECK(len == strlen(want) && strcmp(got, want) == 0);
+    free(got);
+}
+
+#define CHAIN 10
+
+static void stored(void) {
+    char dir[MAX_PATH * 4], path[MAX_PATH * 4];
+    test_tmpdir("delta", dir, sizeof(dir));
+    CHECK(chub_path_join(dir, "delta.db", path, sizeof(path)) == 0);
+    chub_db_configure_crypt(NULL);
+    CHECK(chub_db_open(path) == 0);
+
+    /* each text a small edit of the one before: a chain of near-duplicates */
+    char *texts[CHAIN];
+    int ids[CHAIN];
+    long long ts = chub_now_millis();
+    texts[0] = make_text(1500);
+    for (int i = 0; i < CHAIN; ++i) {
+        if (i) {
+            char tag[32];
+            snprintf(tag, sizeof(tag), "edit%d", i);
+            texts[i] = edit(texts[i - 1], 100 + (size_t)i * 120, 4, tag);
+        }
+        CHECK(chub_db_insert(texts[i], chub_hash64(texts[i]), ts + i, 0) == 0);
+        ids[i] = newest_id();
+    }
+
+    chub_db_stats st;
+    CHECK(chub_db_get_stats(CHAIN, &st) == 0);
+    CHECK(st.entries == CHAIN && st.deltas >= CHAIN / 2);
+    CHECK(st.max_depth == 4 && st.stored_bytes < st.logical_bytes);  /* chains stop at depth 4 */
+    for (int i = 0; i < CHAIN; ++i) check_text(ids[i], texts[i]);
+
+    /* the full-text base goes first: its dependents keep their text */
+    CHECK(chub_db_delete(ids[0]) == 0);
+    char *gone = NULL;
+    CHECK(chub_db_fetch_text(ids[0], &gone, NULL) == 4);
+    for (int i = 1; i < CHAIN; ++i) check_text(ids[i], texts[i]);
+
+    /* then one from the middle of the chain */
+    CHECK(chub_db_delete(ids[CHAIN / 2]) == 0);
+    for (int i = 1; i < CHAIN; ++i)
+        if (i != CHAIN / 2) check_text(ids[i], texts[i]);
+    CHECK(chub_db_get_stats(0, &st) == 0);
+    CHECK(st.entries == CHAIN - 2 && st.max_depth <= 4);
+    chub_db_close();
+
+    /* and after reopening, from disk alone */
+    CHECK(chub_db_open(path) == 0);
+    for (int i = 1; i < CHAIN; ++i)
+        if (i != CHAIN / 2) check_text(ids[i], texts[i]);
+    chub_db_close();
+
+    for (int i = 0; i < CHAIN; ++i) free(texts[i]);
+    test_rmtree(dir);
+}
+
+int main(void) {
+    codec();
+    stored();
+    puts("delta_test: OK");
+    return 0;
+}
@@ -0,0 +1,307 @@
+/* Two (and a third) local instances syncing through a temp directory:
+   export and merge, replay, concurrent favorite/delete, compaction with a
+   peer part way through, and truncated segments. */
+#include "test_util.h"
+#include "chub/db.h"
+#include "chub/resultset.h"
+#include "chub/sync.h"
+#include <sqlite3.h>
+
+#define STATE_MAX 8192
+
+static char g_dir[MAX_PATH * 4];
+static char g_share[MAX_PATH * 4];
+
+static void open_db(const char *name) {
+    char path[MAX_PATH * 4];
+    CHECK(chub_path_join(g_dir, name, path, sizeof(path)) == 0);
+    chub_db_configure_crypt(NULL);
+    CHECK(chub_db_open(path) == 0);
+}
+
+/* distinct, increasing capture times on the real clock: merged deletes
+   compare them with the entry's ts */
+static long long next_ts(void) {
+    static long long last = 0;
+    long long t = chub_now_millis();
+    if (t <= last) t = last + 1;
+    return last = t;
+}
+
+static void ins(const char *text) {
+    CHECK(chub_db_insert(text, chub_hash64(text), next_ts(), 0) == 0);
+}
+
+/* id of the entry holding text, -1 if none; *copies: how many hold it */
+static int find(const char *text, int *copies) {
+    chub_resultset *rs = NULL;
+    CHECK(chub_db_fetch_recent_rs(1000, &rs) == 0);
+    int id = -1, n = 0;
+    for (int i = 0; i < chub_rs_count(rs); ++i)
+        if (strcmp(chub_rs_text(rs, i), text) == 0) { id = chub_rs_id(rs, i); n++; }
+    chub_rs_free(rs);
+    if (copies) *copies = n;
+    return id;
+}
+
+static int is_favorite(const char *text) {
+    chub_resultset *rs = NULL;
+    CHECK(chub_db_fetch_recent_rs(1000, &rs) == 0);
+    int fav = -1;
+    for (int i = 0; i < chub_rs_count(rs); ++i)
+        if (strcmp(chub_rs_text(rs, i), text) == 0) fav = chub_rs_favorite(rs, i);
+    chub_rs_free(rs);
+    return fav;
+}
+
+static void favorite(const char *text, int fav) {
+    int id = find(text, NULL);
+    CHECK(id >= 0);
+    CHECK(chub_db_mark_favorite(id, fav) == 0);
+}
+
+static void delete_text(const char *text) {
+    int id = find(text, NULL);
+    CHECK(id >= 0);
+    CHECK(chub_db_delete(id) == 0);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+/* every entry as "text[*]|", sorted: equal on two instances once merged */
+static void state(char *out) {
+    chub_resultset *rs = NULL;
+    CHECK(chub_db_fetch_recent_rs(1000, &rs) == 0);
+    int n = chub_rs_count(rs);
+    char **rows = (char**)calloc((size_t)(n ? n : 1), sizeof(char*));
+    CHECK(rows);
+    for (int i = 0; i < n; ++i) {
+        size_t len = strlen(chub_rs_text(rs, i)) + 2;
+        rows[i] = (char*)malloc(len);
+        CHECK(rows[i]);
+        snprintf(rows[i], len, "%s%s", chub_rs_text(rs, i), chub_rs_favorite(rs, i) ? "*" : "");
+    }
+    chub_rs_free(rs);
+    qsort(rows, (size_t)n, sizeof(char*), cmp_str);
+    size_t w = 0;
+    out[0] = '\0';
+    for (int i = 0; i < n; ++i) {
+        w += (size_t)snprintf(out + w, STATE_MAX - w, "%s|", rows[i]);
+        CHECK(w < STATE_MAX);
+        free(rows[i]);
+    }
+    free(rows);
+}
+
+static chub_sync_report sync_now(void) {
+    chub_sync_report r;
+    CHECK(chub_sync_run(g_share, &r) == 0);
+    return r;
+}
+
+/* newest segment file of node (names sort by seq) */
+static void last_segment(const char *node, char *out, size_t out_sz) {
+    char dir[MAX_PATH * 4], pattern[MAX_PATH * 4], best[MAX_PATH] = "";
+    CHECK(chub_path_join(g_share, node, dir, sizeof(dir)) == 0);
+    CHECK(chub_path_join(dir, "*.seg", pattern, sizeof(pattern)) == 0);
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    CHECK(h != INVALID_HANDLE_VALUE);
+    do {
+        if (strlen(fd.cFileName) == 37 && strcmp(fd.cFileName, best) > 0)
+            snprintf(best, sizeof(best), "%s", fd.cFileName);
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+    CHECK(best[0]);
+    CHECK(chub_path_join(dir, best, out, out_sz) == 0);
+}
+
+/* cut path to its first bytes; returns the original contents */
+static char *truncate_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    CHECK(f);
+    fseek(f, 0, SEEK_END);
+    *len = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = (char*)malloc(*len);
+    CHECK(buf && fread(buf, 1, *len, f) == *len);
+    fclose(f);
+    f = fopen(path, "wb");
+    CHECK(f && fwrite(buf, 1, 16, f) == 16);
+    fclose(f);
+    return buf;
+}
+
+static void write_file(const char *path, const char *buf, size_t len) {
+    FILE *f = fopen(path, "wb");
+    CHECK(f && fwrite(buf, 1, len, f) == len);
+    fclose(f);
+}
+
+int main(void) {
+    static char sa[STATE_MAX], sb[STATE_MAX], sc[STATE_MAX];
+    char a[CHUB_SYNC_NODE_LEN + 1], b[CHUB_SYNC_NODE_LEN + 1];
+    int copies;
+    chub_sync_report r;
+
+    test_tmpdir("sync", g_dir, sizeof(g_dir));
+    CHECK(chub_path_join(g_dir, "share", g_share, sizeof(g_share)) == 0);
+
+    /* export, then merge: history from before sync was enabled goes too */
+    open_db("a.db");
+    ins("alpha"); ins("beta"); ins("shared");
+    favorite("beta", 1);
+    r = sync_now();
+    snprintf(a, sizeof(a), "%s", r.node);
+    CHECK(r.exported == 4 && r.segments_written == 1 && r.peers == 0);
+    chub_db_close();
+
+    open_db("b.db");
+    ins("gamma"); ins("shared");
+    r = sync_now();
+    snprintf(b, sizeof(b), "%s", r.node);
+    CHECK(strcmp(a, b) != 0);
+    CHECK(r.peers == 1 && r.segments_read == 1);
+    CHECK(find("alpha", NULL) >= 0 && is_favorite("beta") == 1);
+    CHECK(find("shared", &copies) >= 0 && copies == 1);
+    r = sync_now();
+    CHECK(r.exported == 0 && r.segments_read == 0);
+    state(sb);
+    chub_db_close();
+
+    open_db("a.db");
+    r = sync_now();
+    CHECK(r.segments_read == 1);
+    state(sa);
+    CHECK(strcmp(sa, sb) == 0);
+    chub_db_close();
+
+    /* replay: forget how far A was merged; reading it again changes nothing */
+    {
+        char path[MAX_PATH * 4];
+        sqlite3 *raw = NULL;
+        CHECK(chub_path_join(g_dir, "b.db", path, sizeof(path)) == 0);
+        CHECK(sqlite3_open(path, &raw) == SQLITE_OK);
+        CHECK(sqlite3_exec(raw, "UPDATE sync_peers SET seq=0", NULL, NULL, NULL) == SQLITE_OK);
+        sqlite3_close(raw);
+    }
+    open_db("b.db");
+    CHECK(chub_db_peer_seq(a) == 0);
+    r = sync_now();
+    CHECK(r.segments_read == 1 && r.changes_read > 0 && r.applied == 0);
+    CHECK(chub_db_peer_seq(a) > 0);
+    state(sc);
+    CHECK(strcmp(sc, sb) == 0);
+    chub_db_close();
+
+    /* concurrent edits, neither side synced in between: the later clock wins */
+    open_db("a.db");
+    favorite("shared", 1);
+    favorite("gamma", 1);
+    chub_db_close();
+    Sleep(5);
+    open_db("b.db");
+    favorite("shared", 0);
+    favorite("beta", 0);
+    delete_text("gamma");
+    chub_db_close();
+    Sleep(5);
+    open_db("a.db");
+    favorite("beta", 1);
+    sync_now();
+    chub_db_close();
+    open_db("b.db");
+    sync_now();
+    state(sb);
+    CHECK(is_favorite("shared") == 0 && is_favorite("beta") == 1 && find("gamma", NULL) < 0);
+    chub_db_close();
+    open_db("a.db");
+    sync_now();
+    state(sa);
+    CHECK(strcmp(sa, sb) == 0);
+    chub_db_close();
+
+    /* compaction after B has merged part of A's segments */
+    open_db("a.db");
+    for (int i = 0; i < CHUB_SYNC_COMPACT_SEGMENTS / 2; ++i) {
+        char t[32];
+        snprintf(t, sizeof(t), "item %d", i);
+        ins(t);
+        CHECK(sync_now().segments_written == 1);
+    }
+    chub_db_close();
+    open_db("b.db");
+    sync_now();
+    long long partial = chub_db_peer_seq(a);
+    chub_db_close();
+    open_db("a.db");
+    int compacted = 0, dropped = 0;
+    for (int i = CHUB_SYNC_COMPACT_SEGMENTS / 2; i < 4 * CHUB_SYNC_COMPACT_SEGMENTS && !compacted; ++i) {
+        char t[32];
+        snprintf(t, sizeof(t), "item %d", i);
+        ins(t);
+        if (i % 3 == 0) {
+            snprintf(t, sizeof(t), "item %d", i - 1);
+            delete_text(t);  /* its insert is in an earlier segment: superseded */
+        }
+        r = sync_now();
+        compacted = r.compacted;
+        dropped = r.dropped;
+    }
+    CHECK(compacted > CHUB_SYNC_COMPACT_SEGMENTS && dropped > 0);
+    state(sa);
+    chub_db_close();
+    open_db("b.db");
+    r = sync_now();
+    CHECK(r.segments_read >= 1 && chub_db_peer_seq(a) > partial);
+    state(sb);
+    CHECK(strcmp(sa, sb) == 0);
+    r = sync_now();
+    CHECK(r.segments_read == 0);  /* the compacted range counts as merged to its end */
+    chub_db_close();
+    open_db("c.db");
+    sync_now();
+    state(sc);
+    CHECK(strcmp(sa, sc) == 0);
+    r = sync_now();
+    CHECK(r.segments_read == 0 && r.applied == 0);
+    chub_db_close();
+
+    /* a truncated peer segment is skipped, and read once it is whole again */
+    char seg[MAX_PATH * 4];
+    size_t seg_len;
+    open_db("a.db");
+    ins("late");
+    CHECK(sync_now().segments_written == 1);
+    last_segment(a, seg, sizeof(seg));
+    chub_db_close();
+    char *whole = truncate_file(seg, &seg_len);
+    open_db("b.db");
+    long long before = chub_db_peer_seq(a);
+    sync_now();
+    CHECK(find("late", NULL) < 0 && chub_db_peer_seq(a) == before);
+    chub_db_close();
+    write_file(seg, whole, seg_len);
+    open_db("b.db");
+    sync_now();
+    CHECK(find("late", NULL) >= 0);
+    chub_db_close();
+
+    /* a truncated own segment: syncs still succeed, compaction waits */
+    free(truncate_file(seg, &seg_len));
+    open_db("a.db");
+    for (int i = 0; i <= CHUB_SYNC_COMPACT_SEGMENTS; ++i) {
+        char t[32];
+        snprintf(t, sizeof(t), "after %d", i);
+        ins(t);
+        CHECK(sync_now().compacted == 0);
+    }
+    chub_db_close();
+    free(whole);
+
+    test_rmtree(g_dir);
+    puts("sync_test: OK");
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "chub/util.h"
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Shared by the test executables: a failed CHECK prints where and exits
+   non-zero, which is all ctest looks at. */
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+/* a fresh directory under %TEMP%, named after the test and this process */
+static void test_tmpdir(const char *name, char *out, size_t out_sz) {
+    char base[MAX_PATH + 1], leaf[64];
+    CHECK(GetTempPathA(sizeof(base), base) > 0);
+    snprintf(leaf, sizeof(leaf), "chub_%s_%lu", name, (unsigned long)GetCurrentProcessId());
+    CHECK(chub_path_join(base, leaf, out, out_sz) == 0);
+    CHECK(chub_mkdir_p(out) == 0);
+}
+
+static void test_rmtree(const char *dir) {
+    char pattern[MAX_PATH * 4], path[MAX_PATH * 4];
+    if (chub_path_join(dir, "*", pattern, sizeof(pattern)) != 0) return;
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h != INVALID_HANDLE_VALUE) {
+        do {
+            if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0) continue;
+            if (chub_path_join(dir, fd.cFileName, path, sizeof(path)) != 0) continue;
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) test_rmtree(path);
+            else DeleteFileA(path);
+        } while (FindNextFileA(h, &fd));
+        FindClose(h);
+    }
+    RemoveDirectoryA(dir);
+}